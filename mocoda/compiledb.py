@@ -8,6 +8,7 @@ import tempfile
 import hglib
 import json
 import subprocess
+import time
 import whatthepatch
 from distutils.spawn import find_executable
 import logging
@@ -45,6 +46,16 @@ def mach(root, mach_args, check_exit=True):
     return exit
 
 
+def tool(name):
+    """
+    Get the path of one of the mocoda executables built in src/
+    """
+    bindir = os.environ.get('MOCODA_BIN', '')
+    if bindir:
+        return os.path.join(bindir, name)
+    return find_executable(name)
+
+
 def env(restore=False, __env=[]):
     if restore:
         os.environ.clear()
@@ -104,8 +115,59 @@ def compile_tree(root, rev, output, db):
 
     mach(root, ['build', 'export'])
 
+    registry = os.environ.get('MOCODA_REGISTRY', '')
+    if registry and os.path.exists(registry):
+        # the functions in the registry are skipped so it must be empty
+        os.remove(registry)
+
+    cache = os.environ.get('MOCODA_CACHE', '')
+    if cache and not os.path.exists(cache):
+        # the records of the unchanged TUs are reused from a revision to another
+        os.makedirs(cache)
+
+    stats = os.environ.get('MOCODA_STATS', '')
+    if stats:
+        # the counters of each TU are appended to MOCODA_STATS/mocoda.stats
+        shutil.rmtree(stats, ignore_errors=True)
+        os.makedirs(stats)
+
+    # the plugin writes in the database directly when neither the collector
+    # nor a shard is usable
     os.environ['MOCODA_DATABASE'] = db
-    mach(root, ['build', 'compile'])
+    shards = os.environ.get('MOCODA_SHARDS', '')
+    if os.environ.get('MOCODA_COLLECTOR', ''):
+        # the compiler processes send their data to the collector
+        # which is the only one to write in the database
+        socket = db + '.sock'
+        collector = subprocess.Popen([tool('mocoda-collector'), socket, db])
+        while not os.path.exists(socket):
+            if collector.poll() is not None:
+                raise Exception('mocoda-collector exited with code {}'.format(collector.returncode))  # NOQA
+            time.sleep(0.1)
+        os.environ['MOCODA_SOCKET'] = socket
+        try:
+            mach(root, ['build', 'compile'])
+        finally:
+            collector.terminate()
+            collector.wait()
+            del os.environ['MOCODA_SOCKET']
+    elif shards:
+        # each compiler process writes its own shard without locking,
+        # and they're merged into the database once the build is done
+        shutil.rmtree(shards, ignore_errors=True)
+        os.makedirs(shards)
+        mach(root, ['build', 'compile'])
+        subprocess.check_call([tool('mocoda-merge'), db, shards])
+    else:
+        mach(root, ['build', 'compile'])
+
+    if os.environ.get('MOCODA_BULK', ''):
+        # the rows have been appended to the raw tables without any
+        # constraint: they're deduplicated and linked in one pass
+        subprocess.check_call([tool('mocoda-finalize'), db])
+
+    if stats:
+        subprocess.call([tool('mocoda-stats'), stats])
 
     return finalizedb.mk_data(db, rev, output, compress=True)
 
@@ -8,25 +8,27 @@ import sqlite3
 from . import utils
 
 
-def get_table(conn, tableName, rowid):
+def get_table(conn, tableName, columns):
     cursor = conn.cursor()
-    if rowid:
-        cursor.execute('SELECT ROWID,* FROM {};'.format(tableName))
-    else:
-        cursor.execute('SELECT * FROM {};'.format(tableName))
+    cursor.execute('SELECT {} FROM {};'.format(columns, tableName))
 
     return cursor.fetchall()
 
 
 def get_tables(conn):
-    tables = [('definitions', True),
-              ('declarations', True),
-              ('callgraph_resolved', False),
-              ('callgraph_unresolved', False),
-              ('overrides_resolved', False),
-              ('overrides_unresolved', False)]
+    # the file and function names are in the files and names tables
+    defs = ('definitions d JOIN files f ON f.ROWID=d.FILE '
+            'LEFT JOIN names n ON n.ROWID=d.NAME')
+    decls = 'declarations d LEFT JOIN names n ON n.ROWID=d.NAME'
+    tables = [('definitions', defs,
+               "d.ROWID,f.NAME,IFNULL(n.NAME,''),d.BEGIN,d.END,d.ID"),
+              ('declarations', decls, "d.ROWID,IFNULL(n.NAME,''),d.ID,d.DEF"),
+              ('callgraph_resolved', 'callgraph_resolved', '*'),
+              ('callgraph_unresolved', 'callgraph_unresolved', '*'),
+              ('overrides_resolved', 'overrides_resolved', '*'),
+              ('overrides_unresolved', 'overrides_unresolved', '*')]
 
-    return {args[0]: get_table(conn, *args) for args in tables}
+    return {args[0]: get_table(conn, *args[1:]) for args in tables}
 
 
 def short_fun(funname):
@@ -36,11 +38,14 @@ def short_fun(funname):
 def get_defs(defs):
     rows_def = [0] * (len(defs) + 1)
     fun2rowid = defaultdict(lambda: list())
+    id2rowid = {}
     files = set()
-    for rowid, filename, funname, begin, end in defs:
+    for rowid, filename, funname, begin, end, id in defs:
         funname = short_fun(funname)
         rows_def[rowid] = [filename, funname, begin, end, []]
         fun2rowid[funname].append(rowid)
+        if id:
+            id2rowid[id] = rowid
         files.add(filename)
 
     files = list(files)
@@ -49,13 +54,16 @@ def get_defs(defs):
         d = rows_def[i]
         d[0] = file2id[d[0]]
 
-    return rows_def, fun2rowid, files
+    return rows_def, fun2rowid, id2rowid, files
 
 
-def get_decls(decls, fun2rowid):
+def get_decls(decls, fun2rowid, id2rowid):
     rows_dec = [0] * (len(decls) + 1)
-    for rowid, _, funname, _, _, definition in decls:
-        if definition is None:
+    for rowid, funname, id, definition in decls:
+        if definition is None and id:
+            # a declaration has the same id as its definition
+            definition = id2rowid.get(id, 0)
+        elif definition is None:
             # try to resolve the name
             funname = short_fun(funname)
             r = fun2rowid.get(funname, [])
@@ -125,8 +133,8 @@ def mk_data(dbpath, rev, out='', compress=False):
     tables = get_tables(conn)
     conn.close()
 
-    rows_def, fun2rowid, files = get_defs(tables['definitions'])
-    rows_dec = get_decls(tables['declarations'], fun2rowid)
+    rows_def, fun2rowid, id2rowid, files = get_defs(tables['definitions'])
+    rows_dec = get_decls(tables['declarations'], fun2rowid, id2rowid)
     overrides = get_overrides(tables['overrides_resolved'],
                               tables['overrides_unresolved'],
                               rows_dec)
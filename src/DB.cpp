@@ -10,12 +10,20 @@
 
 namespace mocoda
 {
-    DB::DB() : db(nullptr)
+    namespace
+    {
+        // milliseconds waited for a lock held by another connection
+        const int BUSY_TIMEOUT = 60000;
+    }
+
+    DB::DB() : DB(utils::getEnv("MOCODA_DATABASE")) { }
+
+    DB::DB(const std::string & path) : DB(path, !utils::getEnv("MOCODA_BULK").empty()) { }
+
+    DB::DB(const std::string & path, const bool __bulk) : db(nullptr), stmts(), bulk(__bulk), cache(false)
     {
-        const std::string path = utils::getEnv("MOCODA_DATABASE");
         if (!path.empty())
         {
-            const bool exists = utils::exist(path);
             const int rc = sqlite3_open(path.c_str(), &db);
             if (rc)
             {
@@ -23,14 +31,22 @@ namespace mocoda
                           << sqlite3_errmsg(db)
                           << ": " << path
                           << std::endl;
+                sqlite3_close(db);
+                db = nullptr;
+                return;
             }
 
-            if (!exists)
+            // another process can write in the database between two of our
+            // transactions (e.g. the plugin when mocoda-collector is busy)
+            sqlite3_busy_timeout(db, BUSY_TIMEOUT);
+
+            if (!hasTable(bulk ? "raw_definitions" : "definitions"))
             {
                 create();
             }
 
-            os << "BEGIN IMMEDIATE TRANSACTION;";
+            prepare();
+            begin();
         }
     }
 
@@ -38,6 +54,10 @@ namespace mocoda
     {
         if (db)
         {
+            for (auto && stmt : stmts)
+            {
+                sqlite3_finalize(stmt);
+            }
             sqlite3_close(db);
         }
     }
@@ -53,129 +73,422 @@ namespace mocoda
         }
     }
 
-    void DB::insertDefinition(const Info & i)
+    void DB::exec(const char * sql)
     {
-        if (db)
+        char * err = nullptr;
+        const int rc = sqlite3_exec(db, sql, nullptr, nullptr, &err);
+        handleError(rc, err);
+    }
+
+    bool DB::hasTable(const char * name)
+    {
+        sqlite3_stmt * stmt = nullptr;
+        bool has = false;
+        if (sqlite3_prepare_v2(db, "SELECT 1 FROM sqlite_master WHERE type='table' AND name=?1;", -1, &stmt, nullptr) == SQLITE_OK)
         {
-            os << "INSERT OR IGNORE INTO definitions (FILENAME,FUNNAME,BEGIN,END) VALUES ("
-               << '\"' << i.filename << "\","
-               << '\"' << i.funname << "\","
-               << i.begin << ','
-               << i.end
-               << ");";
+            sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+            has = sqlite3_step(stmt) == SQLITE_ROW;
         }
+        sqlite3_finalize(stmt);
+        return has;
     }
 
-    void DB::insertDeclaration(const Info & i, const Info & def)
+    void DB::prepare()
     {
-        if (db)
+        const char * sqls[STATEMENT_COUNT] = {
+            // DEFINITION_SELECT
+            "SELECT ROWID FROM definitions WHERE FILE=?1 AND NAME=?2 AND BEGIN=?3 AND END=?4 AND ID=?5;",
+            // DEFINITION_SELECT_ID
+            "SELECT ROWID,NAME FROM definitions WHERE ID=?1;",
+            // DEFINITION_INSERT
+            "INSERT INTO definitions (FILE,NAME,BEGIN,END,ID) VALUES (?1,?2,?3,?4,?5);",
+            // DEFINITION_NAME
+            "UPDATE definitions SET NAME=?2 WHERE ROWID=?1;",
+            // DECLARATION_SELECT
+            "SELECT ROWID FROM declarations WHERE FILE=?1 AND NAME=?2 AND BEGIN=?3 AND END=?4 AND ID=?5;",
+            // DECLARATION_SELECT_ID
+            "SELECT ROWID,NAME FROM declarations WHERE ID=?1;",
+            // DECLARATION_INSERT
+            "INSERT INTO declarations (FILE,NAME,BEGIN,END,ID,DEF) VALUES (?1,?2,?3,?4,?5,?6);",
+            // DECLARATION_UPDATE
+            "UPDATE declarations SET DEF=?2 WHERE ROWID=?1;",
+            // DECLARATION_NAME
+            "UPDATE declarations SET NAME=?2 WHERE ROWID=?1;",
+            // CALL_RESOLVED
+            "INSERT OR IGNORE INTO callgraph_resolved (CALLER,CALLEE,LINE,COL,VIRTUAL) VALUES (?1,?2,?3,?4,?5);",
+            // CALL_UNRESOLVED
+            "INSERT OR IGNORE INTO callgraph_unresolved (CALLER,CALLEE,LINE,COL,VIRTUAL) VALUES (?1,?2,?3,?4,?5);",
+            // VIRTUAL_RESOLVED
+            "INSERT OR IGNORE INTO overrides_resolved (DEF,VDEF) VALUES (?1,?2);",
+            // VIRTUAL_UNRESOLVED
+            "INSERT OR IGNORE INTO overrides_unresolved (DEF,VDEC) VALUES (?1,?2);",
+            // TEMPLATE_INSERT
+            "INSERT OR IGNORE INTO templates (DEF,COUNT,SAMPLE) VALUES (?1,?2,?3);",
+            // TEMPLATE_UPDATE
+            "UPDATE templates SET COUNT=MAX(COUNT,?2) WHERE DEF=?1;",
+            // BODY_INSERT
+            "INSERT OR IGNORE INTO bodies (DEF,HASH) VALUES (?1,?2);",
+            // FILE_SELECT
+            "SELECT ROWID FROM files WHERE NAME=?1;",
+            // FILE_INSERT
+            "INSERT INTO files (NAME) VALUES (?1);",
+            // NAME_SELECT
+            "SELECT ROWID FROM names WHERE NAME=?1;",
+            // NAME_INSERT
+            "INSERT INTO names (NAME) VALUES (?1);",
+        };
+
+        // nothing is selected or updated in the raw_ tables, where the strings are inlined
+        const char * bulkSqls[STATEMENT_COUNT] = {
+            // DEFINITION_SELECT
+            nullptr,
+            // DEFINITION_SELECT_ID
+            nullptr,
+            // DEFINITION_INSERT
+            "INSERT INTO raw_definitions (FILENAME,FUNNAME,BEGIN,END,ID) VALUES (?1,?2,?3,?4,?5);",
+            // DEFINITION_NAME
+            nullptr,
+            // DECLARATION_SELECT
+            nullptr,
+            // DECLARATION_SELECT_ID
+            nullptr,
+            // DECLARATION_INSERT
+            "INSERT INTO raw_declarations (FILENAME,FUNNAME,BEGIN,END,ID,DEF) VALUES (?1,?2,?3,?4,?5,?6);",
+            // DECLARATION_UPDATE
+            nullptr,
+            // DECLARATION_NAME
+            nullptr,
+            // CALL_RESOLVED
+            "INSERT INTO raw_callgraph_resolved (CALLER,CALLEE,LINE,COL,VIRTUAL) VALUES (?1,?2,?3,?4,?5);",
+            // CALL_UNRESOLVED
+            "INSERT INTO raw_callgraph_unresolved (CALLER,CALLEE,LINE,COL,VIRTUAL) VALUES (?1,?2,?3,?4,?5);",
+            // VIRTUAL_RESOLVED
+            "INSERT INTO raw_overrides_resolved (DEF,VDEF) VALUES (?1,?2);",
+            // VIRTUAL_UNRESOLVED
+            "INSERT INTO raw_overrides_unresolved (DEF,VDEC) VALUES (?1,?2);",
+            // TEMPLATE_INSERT
+            "INSERT INTO raw_templates (DEF,COUNT,SAMPLE) VALUES (?1,?2,?3);",
+            // TEMPLATE_UPDATE
+            nullptr,
+            // BODY_INSERT
+            "INSERT INTO raw_bodies (DEF,HASH) VALUES (?1,?2);",
+            // FILE_SELECT
+            nullptr,
+            // FILE_INSERT
+            nullptr,
+            // NAME_SELECT
+            nullptr,
+            // NAME_INSERT
+            nullptr,
+        };
+
+        for (int i = 0; i < STATEMENT_COUNT; ++i)
         {
-            os << "UPDATE OR IGNORE declarations SET DEF=("
-               << "SELECT ROWID FROM definitions WHERE FILENAME=\"" << def.filename << '\"'
-               << " AND FUNNAME=\"" << def.funname << '\"'
-               << " AND BEGIN=" << def.begin
-               << " AND END=" << def.end
-               << ") WHERE FILENAME=\"" << i.filename << '\"'
-               << " AND FUNNAME=\"" << i.funname << '\"'
-               << " AND BEGIN=" << i.begin
-               << " AND END=" << i.end << ';'
-               << "INSERT OR IGNORE INTO declarations (FILENAME,FUNNAME,BEGIN,END,DEF) VALUES ("
-               << '\"' << i.filename << "\","
-               << '\"' << i.funname << "\","
-               << i.begin << ','
-               << i.end << ','
-               << "(SELECT ROWID FROM definitions WHERE FILENAME=\"" << def.filename << '\"'
-               << " AND FUNNAME=\"" << def.funname << '\"'
-               << " AND BEGIN=" << def.begin
-               << " AND END=" << def.end
-               << "));";
-        }
-    }
-
-    void DB::insertDeclaration(const Info & i)
+            const char * sql = bulk ? bulkSqls[i] : sqls[i];
+            if (!sql)
+            {
+                continue;
+            }
+            const int rc = sqlite3_prepare_v2(db, sql, -1, &stmts[i], nullptr);
+            if (rc != SQLITE_OK)
+            {
+                std::cerr << "SQL error: "
+                          << sqlite3_errmsg(db)
+                          << std::endl;
+            }
+        }
+    }
+
+    RowId DB::intern(const Statement select, const Statement insert, std::unordered_map<std::string, RowId> & ids, const std::string & s)
     {
-        if (db)
+        // 0 stands for the empty string (e.g. a function whose name isn't rendered)
+        if (s.empty())
         {
-            os << "INSERT OR IGNORE INTO declarations (FILENAME,FUNNAME,BEGIN,END,DEF) VALUES ("
-               << '\"' << i.filename << "\","
-               << '\"' << i.funname << "\","
-               << i.begin << ','
-               << i.end << ','
-               << "NULL);";
+            return 0;
         }
+
+        auto i = ids.find(s);
+        if (i != ids.end())
+        {
+            return i->second;
+        }
+
+        sqlite3_bind_text(stmts[select], 1, s.c_str(), s.size(), SQLITE_STATIC);
+        RowId id = this->select(stmts[select]);
+        if (!id)
+        {
+            sqlite3_bind_text(stmts[insert], 1, s.c_str(), s.size(), SQLITE_STATIC);
+            step(stmts[insert]);
+            id = sqlite3_last_insert_rowid(db);
+        }
+        ids.emplace(s, id);
+
+        return id;
     }
 
-    void DB::insertCallResolved(const Info & caller, const Info & callee, const std::size_t line, const std::size_t col, const bool isvirtual)
+    int DB::bind(sqlite3_stmt * stmt, int index, const Info & i)
     {
-        if (db)
+        if (bulk)
+        {
+            sqlite3_bind_text(stmt, index++, i.filename.c_str(), i.filename.size(), SQLITE_STATIC);
+            sqlite3_bind_text(stmt, index++, i.funname.c_str(), i.funname.size(), SQLITE_STATIC);
+        }
+        else
+        {
+            sqlite3_bind_int64(stmt, index++, intern(FILE_SELECT, FILE_INSERT, fileIds, i.filename));
+            sqlite3_bind_int64(stmt, index++, intern(NAME_SELECT, NAME_INSERT, nameIds, i.funname));
+        }
+        sqlite3_bind_int64(stmt, index++, i.begin);
+        sqlite3_bind_int64(stmt, index++, i.end);
+        sqlite3_bind_int64(stmt, index++, i.id);
+        return index;
+    }
+
+    void DB::step(sqlite3_stmt * stmt)
+    {
+        const int rc = sqlite3_step(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "SQL error: "
+                      << sqlite3_errmsg(db)
+                      << std::endl;
+        }
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+
+    RowId DB::select(sqlite3_stmt * stmt)
+    {
+        RowId id = 0;
+        const int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW)
+        {
+            id = sqlite3_column_int64(stmt, 0);
+        }
+        else if (rc != SQLITE_DONE)
+        {
+            std::cerr << "SQL error: "
+                      << sqlite3_errmsg(db)
+                      << std::endl;
+        }
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        return id;
+    }
+
+    RowId DB::select(const Statement select, const Statement selectId, const Statement name, const Info & i)
+    {
+        if (!i.id)
+        {
+            bind(stmts[select], 1, i);
+            return this->select(stmts[select]);
+        }
+
+        // the functions with an id are only identified by it
+        sqlite3_stmt * stmt = stmts[selectId];
+        RowId id = 0;
+        bool unnamed = false;
+        sqlite3_bind_int64(stmt, 1, i.id);
+        const int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW)
+        {
+            id = sqlite3_column_int64(stmt, 0);
+            unnamed = sqlite3_column_int64(stmt, 1) == 0;
+        }
+        else if (rc != SQLITE_DONE)
+        {
+            std::cerr << "SQL error: "
+                      << sqlite3_errmsg(db)
+                      << std::endl;
+        }
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+
+        if (id && unnamed && !i.funname.empty())
         {
-            os << "INSERT OR IGNORE INTO callgraph_resolved (CALLER,CALLEE,LINE,COL,VIRTUAL) VALUES ("
-               << "(SELECT ROWID FROM definitions WHERE FILENAME=\"" << caller.filename << '\"'
-               << " AND FUNNAME=\"" << caller.funname << '\"'
-               << " AND BEGIN=" << caller.begin
-               << " AND END=" << caller.end
-               << "),(SELECT ROWID FROM definitions WHERE FILENAME=\"" << callee.filename << '\"'
-               << " AND FUNNAME=\"" << callee.funname << '\"'
-               << " AND BEGIN=" << callee.begin
-               << " AND END=" << callee.end << "),"
-               << line << ','
-               << col << ','
-               << isvirtual
-               << ");";
+            // the row has been inserted by a TU which didn't render the name
+            const RowId n = intern(NAME_SELECT, NAME_INSERT, nameIds, i.funname);
+            stmt = stmts[name];
+            sqlite3_bind_int64(stmt, 1, id);
+            sqlite3_bind_int64(stmt, 2, n);
+            step(stmt);
         }
+
+        return id;
     }
 
-    void DB::insertCallUnresolved(const Info & caller, const Info & callee, const std::size_t line, const std::size_t col, const bool isvirtual)
+    void DB::enableCache()
+    {
+        cache = true;
+    }
+
+    RowId DB::insertDefinition(const Info & i)
+    {
+        if (db && cache)
+        {
+            auto it = defCache.find(i);
+            if (it == defCache.end())
+            {
+                return defCache.emplace(i, selectOrInsertDefinition(i)).first->second;
+            }
+            return it->second;
+        }
+
+        return selectOrInsertDefinition(i);
+    }
+
+    RowId DB::selectOrInsertDefinition(const Info & i)
     {
         if (db)
         {
-            os << "INSERT OR IGNORE INTO callgraph_unresolved (CALLER,CALLEE,LINE,COL,VIRTUAL) VALUES ("
-               << "(SELECT ROWID FROM definitions WHERE FILENAME=\"" << caller.filename << '\"'
-               << " AND FUNNAME=\"" << caller.funname << '\"'
-               << " AND BEGIN=" << caller.begin
-               << " AND END=" << caller.end
-               << "),(SELECT ROWID FROM declarations WHERE FILENAME=\"" << callee.filename << '\"'
-               << " AND FUNNAME=\"" << callee.funname << '\"'
-               << " AND BEGIN=" << callee.begin
-               << " AND END=" << callee.end << "),"
-               << line << ','
-               << col << ','
-               << isvirtual
-               << ");";
+            // the raw rows are never selected: finalize() deduplicates them
+            if (const RowId id = bulk ? 0 : select(DEFINITION_SELECT, DEFINITION_SELECT_ID, DEFINITION_NAME, i))
+            {
+                return id;
+            }
+
+            bind(stmts[DEFINITION_INSERT], 1, i);
+            step(stmts[DEFINITION_INSERT]);
+            return sqlite3_last_insert_rowid(db);
         }
+        return 0;
     }
 
-    void DB::insertVirtualResolved(const Info & def, const Info & vdef)
+    RowId DB::insertDeclaration(const Info & i, const RowId def)
+    {
+        if (db && cache)
+        {
+            auto it = declCache.find(i);
+            if (it == declCache.end() || (def && !it->second.second))
+            {
+                const RowId id = selectOrInsertDeclaration(i, def);
+                declCache[i] = std::make_pair(id, def != 0);
+                return id;
+            }
+            return it->second.first;
+        }
+
+        return selectOrInsertDeclaration(i, def);
+    }
+
+    RowId DB::selectOrInsertDeclaration(const Info & i, const RowId def)
     {
         if (db)
         {
-            os << "INSERT OR IGNORE INTO overrides_resolved (DEF,VDEF) VALUES ("
-               << "(SELECT ROWID FROM definitions WHERE FILENAME=\"" << def.filename << '\"'
-               << " AND FUNNAME=\"" << def.funname << '\"'
-               << " AND BEGIN=" << def.begin
-               << " AND END=" << def.end
-               << "),(SELECT ROWID FROM definitions WHERE FILENAME=\"" << vdef.filename << '\"'
-               << " AND FUNNAME=\"" << vdef.funname << '\"'
-               << " AND BEGIN=" << vdef.begin
-               << " AND END=" << vdef.end
-               << "));";
+            if (const RowId id = bulk ? 0 : select(DECLARATION_SELECT, DECLARATION_SELECT_ID, DECLARATION_NAME, i))
+            {
+                if (def)
+                {
+                    sqlite3_stmt * stmt = stmts[DECLARATION_UPDATE];
+                    sqlite3_bind_int64(stmt, 1, id);
+                    sqlite3_bind_int64(stmt, 2, def);
+                    step(stmt);
+                }
+                return id;
+            }
+
+            sqlite3_stmt * stmt = stmts[DECLARATION_INSERT];
+            const int index = bind(stmt, 1, i);
+            if (def)
+            {
+                sqlite3_bind_int64(stmt, index, def);
+            }
+            else
+            {
+                sqlite3_bind_null(stmt, index);
+            }
+            step(stmt);
+            return sqlite3_last_insert_rowid(db);
+        }
+        return 0;
+    }
+
+    void DB::insertEdge(sqlite3_stmt * stmt, const RowId from, const RowId to)
+    {
+        if (db && from && to)
+        {
+            sqlite3_bind_int64(stmt, 1, from);
+            sqlite3_bind_int64(stmt, 2, to);
+            step(stmt);
         }
     }
 
-    void DB::insertVirtualUnresolved(const Info & def, const Info & vdec)
+    void DB::insertCall(sqlite3_stmt * stmt, const RowId caller, const RowId callee, const std::size_t line, const std::size_t col, const bool isvirtual)
+    {
+        if (db && caller && callee)
+        {
+            sqlite3_bind_int64(stmt, 1, caller);
+            sqlite3_bind_int64(stmt, 2, callee);
+            sqlite3_bind_int64(stmt, 3, line);
+            sqlite3_bind_int64(stmt, 4, col);
+            sqlite3_bind_int(stmt, 5, isvirtual);
+            step(stmt);
+        }
+    }
+
+    void DB::insertCallResolved(const RowId caller, const RowId callee, const std::size_t line, const std::size_t col, const bool isvirtual)
+    {
+        insertCall(stmts[CALL_RESOLVED], caller, callee, line, col, isvirtual);
+    }
+
+    void DB::insertCallUnresolved(const RowId caller, const RowId callee, const std::size_t line, const std::size_t col, const bool isvirtual)
+    {
+        insertCall(stmts[CALL_UNRESOLVED], caller, callee, line, col, isvirtual);
+    }
+
+    void DB::insertVirtualResolved(const RowId def, const RowId vdef)
+    {
+        insertEdge(stmts[VIRTUAL_RESOLVED], def, vdef);
+    }
+
+    void DB::insertVirtualUnresolved(const RowId def, const RowId vdec)
+    {
+        insertEdge(stmts[VIRTUAL_UNRESOLVED], def, vdec);
+    }
+
+    void DB::insertTemplate(const RowId def, const std::size_t count, const std::string & sample)
+    {
+        if (db && def)
+        {
+            sqlite3_stmt * stmt = stmts[TEMPLATE_INSERT];
+            sqlite3_bind_int64(stmt, 1, def);
+            sqlite3_bind_int64(stmt, 2, count);
+            if (bulk)
+            {
+                sqlite3_bind_text(stmt, 3, sample.c_str(), sample.size(), SQLITE_STATIC);
+            }
+            else
+            {
+                sqlite3_bind_int64(stmt, 3, intern(NAME_SELECT, NAME_INSERT, nameIds, sample));
+            }
+            step(stmt);
+
+            if (!bulk && !sqlite3_changes(db))
+            {
+                stmt = stmts[TEMPLATE_UPDATE];
+                sqlite3_bind_int64(stmt, 1, def);
+                sqlite3_bind_int64(stmt, 2, count);
+                step(stmt);
+            }
+        }
+    }
+
+    void DB::insertBody(const RowId def, const std::uint64_t hash)
+    {
+        if (db && def)
+        {
+            sqlite3_stmt * stmt = stmts[BODY_INSERT];
+            sqlite3_bind_int64(stmt, 1, def);
+            sqlite3_bind_int64(stmt, 2, hash);
+            step(stmt);
+        }
+    }
+
+    void DB::begin()
     {
         if (db)
         {
-            os << "INSERT OR IGNORE INTO overrides_unresolved (DEF,VDEC) VALUES ("
-               << "(SELECT ROWID FROM definitions WHERE FILENAME=\"" << def.filename << '\"'
-               << " AND FUNNAME=\"" << def.funname << '\"'
-               << " AND BEGIN=" << def.begin
-               << " AND END=" << def.end
-               << "),(SELECT ROWID FROM declarations WHERE FILENAME=\"" << vdec.filename << '\"'
-               << " AND FUNNAME=\"" << vdec.funname << '\"'
-               << " AND BEGIN=" << vdec.begin
-               << " AND END=" << vdec.end
-               << "));";
+            exec("BEGIN IMMEDIATE TRANSACTION;");
         }
     }
 
@@ -183,31 +496,122 @@ namespace mocoda
     {
         if (db)
         {
-            char * err = nullptr;
-            os << "COMMIT TRANSACTION;";
-            const int rc = sqlite3_exec(db, os.str().c_str(), nullptr, nullptr, &err);
-            handleError(rc, err);
-
-            os.str("");
-            os.clear();
+            exec("COMMIT TRANSACTION;");
         }
     }
 
     void DB::create()
     {
-        if (db)
+        if (db && bulk)
+        {
+            exec("CREATE TABLE raw_definitions(FILENAME CHAR(256),FUNNAME TEXT,BEGIN INTEGER,END INTEGER,ID INTEGER);"
+                 "CREATE TABLE raw_declarations(FILENAME CHAR(256),FUNNAME TEXT,BEGIN INTEGER,END INTEGER,ID INTEGER,DEF INTEGER);"
+                 "CREATE TABLE raw_callgraph_resolved(CALLER INTEGER,CALLEE INTEGER,LINE INTEGER,COL INTEGER,VIRTUAL BOOLEAN);"
+                 "CREATE TABLE raw_callgraph_unresolved(CALLER INTEGER,CALLEE INTEGER,LINE INTEGER,COL INTEGER,VIRTUAL BOOLEAN);"
+                 "CREATE TABLE raw_overrides_resolved(DEF INTEGER,VDEF INTEGER);"
+                 "CREATE TABLE raw_overrides_unresolved(DEF INTEGER,VDEC INTEGER);"
+                 "CREATE TABLE raw_templates(DEF INTEGER,COUNT INTEGER,SAMPLE TEXT);"
+                 "CREATE TABLE raw_bodies(DEF INTEGER,HASH INTEGER);");
+        }
+        else if (db)
+        {
+            exec("CREATE TABLE files(NAME TEXT UNIQUE);"
+                 "CREATE TABLE names(NAME TEXT UNIQUE);"
+                 "CREATE TABLE definitions(FILE INTEGER,NAME INTEGER,BEGIN INTEGER,END INTEGER,ID INTEGER DEFAULT 0,FOREIGN KEY(FILE) REFERENCES files(ROWID),FOREIGN KEY(NAME) REFERENCES names(ROWID),UNIQUE(FILE,NAME,BEGIN,END,ID));"
+                 "CREATE INDEX definitions_id ON definitions(ID);"
+                 "CREATE TABLE declarations(FILE INTEGER,NAME INTEGER,BEGIN INTEGER,END INTEGER,ID INTEGER DEFAULT 0,DEF INTEGER,FOREIGN KEY(FILE) REFERENCES files(ROWID),FOREIGN KEY(NAME) REFERENCES names(ROWID),FOREIGN KEY(DEF) REFERENCES definitions(ROWID),UNIQUE(FILE,NAME,BEGIN,END,ID));"
+                 "CREATE INDEX declarations_id ON declarations(ID);"
+                 "CREATE TABLE callgraph_resolved(CALLER INTEGER,CALLEE INTEGER,LINE INTEGER,COL INTEGER,VIRTUAL BOOLEAN,FOREIGN KEY(CALLER) REFERENCES definitions(ROWID),FOREIGN KEY(CALLEE) REFERENCES definitions(ROWID),UNIQUE(CALLER,CALLEE,LINE,COL,VIRTUAL));"
+                 "CREATE TABLE callgraph_unresolved(CALLER INTEGER,CALLEE INTEGER,LINE INTEGER,COL INTEGER,VIRTUAL BOOLEAN,FOREIGN KEY(CALLER) REFERENCES definitions(ROWID),FOREIGN KEY(CALLEE) REFERENCES declarations(ROWID),UNIQUE(CALLER,CALLEE,LINE,COL,VIRTUAL));"
+                 "CREATE TABLE overrides_resolved(DEF INTEGER,VDEF INTEGER,FOREIGN KEY(DEF) REFERENCES definitions(ROWID),FOREIGN KEY(VDEF) REFERENCES definitions(ROWID),UNIQUE(DEF,VDEF));"
+                 "CREATE TABLE overrides_unresolved(DEF INTEGER,VDEC INTEGER,FOREIGN KEY(DEF) REFERENCES definitions(ROWID),FOREIGN KEY(VDEC) REFERENCES declarations(ROWID),UNIQUE(DEF,VDEC));"
+                 "CREATE TABLE templates(DEF INTEGER PRIMARY KEY,COUNT INTEGER,SAMPLE INTEGER,FOREIGN KEY(DEF) REFERENCES definitions(ROWID),FOREIGN KEY(SAMPLE) REFERENCES names(ROWID));"
+                 "CREATE TABLE bodies(DEF INTEGER PRIMARY KEY,HASH INTEGER,FOREIGN KEY(DEF) REFERENCES definitions(ROWID));"
+                 "CREATE INDEX bodies_hash ON bodies(HASH);");
+        }
+    }
+
+    void DB::finalize()
+    {
+        // the raw rows reference each other by their ROWID: the maps give the
+        // ROWID of the deduplicated row for each raw row
+        if (db && !bulk && hasTable("raw_definitions"))
         {
-            char * err = nullptr;
-            const char * s =
-                "CREATE TABLE definitions(FILENAME CHAR(256),FUNNAME TEXT,BEGIN INTEGER,END INTEGER,UNIQUE(FILENAME,FUNNAME,BEGIN,END));"
-                "CREATE TABLE declarations(FILENAME CHAR(256),FUNNAME TEXT,BEGIN INTEGER,END INTEGER,DEF INTEGER,FOREIGN KEY(DEF) REFERENCES definitions(ROWID),UNIQUE(FILENAME,FUNNAME,BEGIN,END));"
-                "CREATE TABLE callgraph_resolved(CALLER INTEGER,CALLEE INTEGER,LINE INTEGER,COL INTEGER,VIRTUAL BOOLEAN,FOREIGN KEY(CALLER) REFERENCES definitions(ROWID),FOREIGN KEY(CALLEE) REFERENCES definitions(ROWID),UNIQUE(CALLER,CALLEE,LINE,COL,VIRTUAL));"
-                "CREATE TABLE callgraph_unresolved(CALLER INTEGER,CALLEE INTEGER,LINE INTEGER,COL INTEGER,VIRTUAL BOOLEAN,FOREIGN KEY(CALLER) REFERENCES definitions(ROWID),FOREIGN KEY(CALLEE) REFERENCES declarations(ROWID),UNIQUE(CALLER,CALLEE,LINE,COL,VIRTUAL));"
-                "CREATE TABLE overrides_resolved(DEF INTEGER,VDEF INTEGER,FOREIGN KEY(DEF) REFERENCES definitions(ROWID),FOREIGN KEY(VDEF) REFERENCES definitions(ROWID),UNIQUE(DEF,VDEF));"
-                "CREATE TABLE overrides_unresolved(DEF INTEGER,VDEC INTEGER,FOREIGN KEY(DEF) REFERENCES definitions(ROWID),FOREIGN KEY(VDEC) REFERENCES declarations(ROWID),UNIQUE(DEF,VDEC));";
-
-            const int rc = sqlite3_exec(db, s, nullptr, nullptr, &err);
-            handleError(rc, err);
+            exec("INSERT OR IGNORE INTO files (NAME) "
+                 "SELECT FILENAME FROM raw_definitions UNION SELECT FILENAME FROM raw_declarations;"
+                 "INSERT OR IGNORE INTO names (NAME) "
+                 "SELECT FUNNAME FROM raw_definitions WHERE FUNNAME<>'' UNION SELECT FUNNAME FROM raw_declarations WHERE FUNNAME<>'' "
+                 "UNION SELECT SAMPLE FROM raw_templates WHERE SAMPLE<>'';"
+
+                 // the raw rows with the rowids of their strings (0 for the empty name)
+                 "CREATE TEMP TABLE staged_definitions AS SELECT r.ROWID AS RAW,f.ROWID AS FILE,IFNULL(n.ROWID,0) AS NAME,r.BEGIN AS BEGIN,r.END AS END,r.ID AS ID "
+                 "FROM raw_definitions r JOIN files f ON f.NAME=r.FILENAME LEFT JOIN names n ON n.NAME=r.FUNNAME;"
+                 "CREATE TEMP TABLE staged_declarations AS SELECT r.ROWID AS RAW,f.ROWID AS FILE,IFNULL(n.ROWID,0) AS NAME,r.BEGIN AS BEGIN,r.END AS END,r.ID AS ID,r.DEF AS DEF "
+                 "FROM raw_declarations r JOIN files f ON f.NAME=r.FILENAME LEFT JOIN names n ON n.NAME=r.FUNNAME;"
+                 "CREATE INDEX staged_definitions_id ON staged_definitions(ID);"
+                 "CREATE INDEX staged_declarations_id ON staged_declarations(ID);"
+                 "CREATE TEMP TABLE def_map(RAW INTEGER PRIMARY KEY,ROW INTEGER);"
+                 "CREATE TEMP TABLE decl_map(RAW INTEGER PRIMARY KEY,ROW INTEGER);"
+                 "CREATE TEMP TABLE decl_def(ROW INTEGER PRIMARY KEY,DEF INTEGER);"
+
+                 // the functions without an id are identified by all their columns and the
+                 // ones with an id only by it, their name being empty in some TUs (see DB::select)
+                 "INSERT OR IGNORE INTO definitions (FILE,NAME,BEGIN,END,ID) "
+                 "SELECT DISTINCT FILE,NAME,BEGIN,END,ID FROM staged_definitions WHERE ID=0;"
+                 "INSERT INTO definitions (FILE,NAME,BEGIN,END,ID) "
+                 "SELECT FILE,MAX(NAME),BEGIN,END,ID FROM staged_definitions WHERE ID<>0 AND ID NOT IN (SELECT ID FROM definitions) GROUP BY ID;"
+                 "UPDATE definitions SET NAME=(SELECT MAX(NAME) FROM staged_definitions r WHERE r.ID=definitions.ID) "
+                 "WHERE ID<>0 AND NAME=0 AND ID IN (SELECT ID FROM staged_definitions);"
+                 "INSERT OR IGNORE INTO def_map SELECT r.RAW,d.ROWID FROM staged_definitions r JOIN definitions d "
+                 "ON d.FILE=r.FILE AND d.NAME=r.NAME AND d.BEGIN=r.BEGIN AND d.END=r.END AND d.ID=r.ID WHERE r.ID=0;"
+                 "INSERT OR IGNORE INTO def_map SELECT r.RAW,d.ROWID FROM staged_definitions r JOIN definitions d ON d.ID=r.ID WHERE r.ID<>0;"
+
+                 "INSERT OR IGNORE INTO declarations (FILE,NAME,BEGIN,END,ID) "
+                 "SELECT DISTINCT FILE,NAME,BEGIN,END,ID FROM staged_declarations WHERE ID=0;"
+                 "INSERT INTO declarations (FILE,NAME,BEGIN,END,ID) "
+                 "SELECT FILE,MAX(NAME),BEGIN,END,ID FROM staged_declarations WHERE ID<>0 AND ID NOT IN (SELECT ID FROM declarations) GROUP BY ID;"
+                 "UPDATE declarations SET NAME=(SELECT MAX(NAME) FROM staged_declarations r WHERE r.ID=declarations.ID) "
+                 "WHERE ID<>0 AND NAME=0 AND ID IN (SELECT ID FROM staged_declarations);"
+                 "INSERT OR IGNORE INTO decl_map SELECT r.RAW,d.ROWID FROM staged_declarations r JOIN declarations d "
+                 "ON d.FILE=r.FILE AND d.NAME=r.NAME AND d.BEGIN=r.BEGIN AND d.END=r.END AND d.ID=r.ID WHERE r.ID=0;"
+                 "INSERT OR IGNORE INTO decl_map SELECT r.RAW,d.ROWID FROM staged_declarations r JOIN declarations d ON d.ID=r.ID WHERE r.ID<>0;"
+
+                 "CREATE TEMP TABLE staged_templates AS SELECT m.ROW AS DEF,MAX(r.COUNT) AS COUNT,MIN(n.ROWID) AS SAMPLE "
+                 "FROM raw_templates r JOIN def_map m ON m.RAW=r.DEF LEFT JOIN names n ON n.NAME=r.SAMPLE GROUP BY m.ROW;"
+                 "INSERT OR IGNORE INTO templates SELECT DEF,COUNT,SAMPLE FROM staged_templates;"
+                 "UPDATE templates SET COUNT=(SELECT MAX(t.COUNT,templates.COUNT) FROM staged_templates t WHERE t.DEF=templates.DEF) "
+                 "WHERE DEF IN (SELECT DEF FROM staged_templates);"
+                 "INSERT OR IGNORE INTO bodies SELECT m.ROW,r.HASH FROM raw_bodies r JOIN def_map m ON m.RAW=r.DEF;"
+
+                 // a declaration is linked to its definition in the TUs which have the body
+                 "INSERT INTO decl_def SELECT d.ROW,MAX(m.ROW) FROM staged_declarations r "
+                 "JOIN decl_map d ON d.RAW=r.RAW JOIN def_map m ON m.RAW=r.DEF GROUP BY d.ROW;"
+                 "UPDATE declarations SET DEF=(SELECT DEF FROM decl_def WHERE decl_def.ROW=declarations.ROWID) "
+                 "WHERE DEF IS NULL AND ROWID IN (SELECT ROW FROM decl_def);"
+
+                 "INSERT OR IGNORE INTO callgraph_resolved SELECT a.ROW,b.ROW,r.LINE,r.COL,r.VIRTUAL FROM raw_callgraph_resolved r "
+                 "JOIN def_map a ON a.RAW=r.CALLER JOIN def_map b ON b.RAW=r.CALLEE;"
+                 "INSERT OR IGNORE INTO callgraph_unresolved SELECT a.ROW,b.ROW,r.LINE,r.COL,r.VIRTUAL FROM raw_callgraph_unresolved r "
+                 "JOIN def_map a ON a.RAW=r.CALLER JOIN decl_map b ON b.RAW=r.CALLEE;"
+                 "INSERT OR IGNORE INTO overrides_resolved SELECT a.ROW,b.ROW FROM raw_overrides_resolved r "
+                 "JOIN def_map a ON a.RAW=r.DEF JOIN def_map b ON b.RAW=r.VDEF;"
+                 "INSERT OR IGNORE INTO overrides_unresolved SELECT a.ROW,b.ROW FROM raw_overrides_unresolved r "
+                 "JOIN def_map a ON a.RAW=r.DEF JOIN decl_map b ON b.RAW=r.VDEC;"
+
+                 "DROP TABLE staged_definitions;"
+                 "DROP TABLE staged_declarations;"
+                 "DROP TABLE staged_templates;"
+                 "DROP TABLE def_map;"
+                 "DROP TABLE decl_map;"
+                 "DROP TABLE decl_def;"
+                 "DROP TABLE raw_definitions;"
+                 "DROP TABLE raw_declarations;"
+                 "DROP TABLE raw_callgraph_resolved;"
+                 "DROP TABLE raw_callgraph_unresolved;"
+                 "DROP TABLE raw_overrides_resolved;"
+                 "DROP TABLE raw_overrides_unresolved;"
+                 "DROP TABLE raw_templates;"
+                 "DROP TABLE raw_bodies;");
         }
     }
 }
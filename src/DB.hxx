@@ -5,37 +5,97 @@
 #ifndef __DB_HXX__
 #define __DB_HXX__
 
-#include <sstream>
 #include <sqlite3.h>
 #include <string>
+#include <unordered_map>
+#include <utility>
 
 #include "info.hxx"
 
 namespace mocoda
 {
+    typedef sqlite3_int64 RowId;
+
     class DB
     {
+        enum Statement
+        {
+            DEFINITION_SELECT,
+            DEFINITION_SELECT_ID,
+            DEFINITION_INSERT,
+            DEFINITION_NAME,
+            DECLARATION_SELECT,
+            DECLARATION_SELECT_ID,
+            DECLARATION_INSERT,
+            DECLARATION_UPDATE,
+            DECLARATION_NAME,
+            CALL_RESOLVED,
+            CALL_UNRESOLVED,
+            VIRTUAL_RESOLVED,
+            VIRTUAL_UNRESOLVED,
+            TEMPLATE_INSERT,
+            TEMPLATE_UPDATE,
+            BODY_INSERT,
+            FILE_SELECT,
+            FILE_INSERT,
+            NAME_SELECT,
+            NAME_INSERT,
+            STATEMENT_COUNT
+        };
+
         sqlite3 * db;
-        std::ostringstream os;
+        sqlite3_stmt * stmts[STATEMENT_COUNT];
+        // the rows are appended to the raw_ tables without any constraint
+        // and finalize() deduplicates and links them once the build is done
+        const bool bulk;
+        bool cache;
+        std::unordered_map<Info, RowId, InfoHash> defCache;
+        // the flag is true when the declaration is linked to its definition
+        std::unordered_map<Info, std::pair<RowId, bool>, InfoHash> declCache;
+        // the rowids of the strings in the files and names tables
+        std::unordered_map<std::string, RowId> fileIds;
+        std::unordered_map<std::string, RowId> nameIds;
 
     public:
 
         DB();
+        explicit DB(const std::string & path);
+        DB(const std::string & path, const bool __bulk);
         ~DB();
 
-        void insertVirtual(const Info & i);
-        void insertDefinition(const Info & i);
-        void insertDeclaration(const Info & i, const Info & def);
-        void insertDeclaration(const Info & i);
-        void insertCallResolved(const Info & caller, const Info & callee, const std::size_t line, const std::size_t col, const bool isvirtual);
-        void insertCallUnresolved(const Info & caller, const Info & callee, const std::size_t line, const std::size_t col, const bool isvirtual);
-        void insertVirtualResolved(const Info & def, const Info & vdef);
-        void insertVirtualUnresolved(const Info & def, const Info & vdec);
+        RowId insertDefinition(const Info & i);
+        RowId insertDeclaration(const Info & i, const RowId def = 0);
+        void insertCallResolved(const RowId caller, const RowId callee, const std::size_t line, const std::size_t col, const bool isvirtual);
+        void insertCallUnresolved(const RowId caller, const RowId callee, const std::size_t line, const std::size_t col, const bool isvirtual);
+        void insertVirtualResolved(const RowId def, const RowId vdef);
+        void insertVirtualUnresolved(const RowId def, const RowId vdec);
+        // count is the number of instantiations of the template in a TU: the largest one is kept
+        void insertTemplate(const RowId def, const std::size_t count, const std::string & sample);
+        void insertBody(const RowId def, const std::uint64_t hash);
+        void begin();
         void commit();
         void create();
+        // move the rows of the raw_ tables in the tables with the usual schema
+        void finalize();
+        // keep the rowids in memory, which is worth it when the same
+        // functions are inserted again and again (e.g. header functions
+        // coming from many TUs)
+        void enableCache();
 
     private:
 
+        bool hasTable(const char * name);
+        void prepare();
+        void exec(const char * sql);
+        int bind(sqlite3_stmt * stmt, int index, const Info & i);
+        RowId intern(const Statement select, const Statement insert, std::unordered_map<std::string, RowId> & ids, const std::string & s);
+        void step(sqlite3_stmt * stmt);
+        RowId select(sqlite3_stmt * stmt);
+        RowId select(const Statement select, const Statement selectId, const Statement name, const Info & i);
+        RowId selectOrInsertDefinition(const Info & i);
+        RowId selectOrInsertDeclaration(const Info & i, const RowId def);
+        void insertEdge(sqlite3_stmt * stmt, const RowId from, const RowId to);
+        void insertCall(sqlite3_stmt * stmt, const RowId caller, const RowId callee, const std::size_t line, const std::size_t col, const bool isvirtual);
         void handleError(const int rc, char * err);
     };
 }
@@ -0,0 +1,96 @@
+#!/bin/sh
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this file,
+# You can obtain one at http://mozilla.org/MPL/2.0/.
+
+# Compile synthetic TUs (see mocoda-gentu) without the plugin, with the
+# plugin and with the plugin and MOCODA_CG, and write one JSON object
+# per run to OUTPUT:
+#   wall: time to compile all the TUs
+#   plugin: time spent in the plugin traversing the AST and collecting the records
+#   db: time spent waiting on the lock, writing and committing
+#   size: size of the database
+#
+# Usage: bench.sh [OUTPUT]
+#
+# BENCH_CXX, BENCH_DIR, BENCH_RUNS and BENCH_SHAPES (options of mocoda-gentu
+# separated by ';') can be set to change the defaults.
+
+set -e
+
+BIN=$(cd "$(dirname "$0")" && pwd)
+OUTPUT=${1:-bench.json}
+CXX=${BENCH_CXX:-clang++-4.0}
+DIR=${BENCH_DIR:-/tmp/mocoda-bench}
+RUNS=${BENCH_RUNS:-3}
+SHAPES=${BENCH_SHAPES:-"-t 8 -f 100;-t 8 -f 400 -d 32 -c 8;-t 16 -f 100 -v 16 -h 32 -i 16"}
+
+now() {
+    date +%s.%N
+}
+
+# sum the columns of mocoda.stats (see counters.hxx) for the plugin and the database
+stats() {
+    if [ -f "$DIR/stats/mocoda.stats" ]; then
+        awk -F '\t' '{ p += $2 + $3; d += $4 + $5 + $6 } END { printf "%f %f", p, d }' "$DIR/stats/mocoda.stats"
+    else
+        echo "0 0"
+    fi
+}
+
+run() {
+    shape=$1
+    config=$2
+    i=$3
+    flags=""
+
+    rm -rf "$DIR/stats" "$DIR/db.sqlite"
+    mkdir -p "$DIR/stats"
+    touch "$DIR/lock"
+    unset MOCODA_CG
+    if [ "$config" != "none" ]; then
+        flags="-fplugin=$BIN/libmocoda.so"
+    fi
+    if [ "$config" = "cg" ]; then
+        export MOCODA_CG=1
+    fi
+
+    start=$(now)
+    for tu in "$DIR"/src/*.cpp; do
+        $CXX -std=c++11 -w -O0 -g0 $flags -c "$tu" -o "$DIR/tu.o"
+    done
+    end=$(now)
+
+    set -- $(stats)
+    size=0
+    if [ -f "$DIR/db.sqlite" ]; then
+        size=$(wc -c < "$DIR/db.sqlite")
+    fi
+
+    printf '{"shape": "%s", "config": "%s", "run": %d, "wall": %f, "plugin": %s, "db": %s, "size": %d}\n' \
+           "$shape" "$config" "$i" "$(awk "BEGIN { print $end - $start }")" "$1" "$2" "$size" >> "$OUTPUT"
+}
+
+rm -rf "$DIR"
+mkdir -p "$DIR"
+: > "$OUTPUT"
+
+export MOCODA_ROOT="$(cd "$DIR" && pwd -P)/"
+export MOCODA_DATABASE="$DIR/db.sqlite"
+export MOCODA_LOCK="$DIR/lock"
+export MOCODA_STATS="$DIR/stats"
+
+echo "$SHAPES" | tr ';' '\n' | while read -r shape; do
+    rm -rf "$DIR/src"
+    mkdir -p "$DIR/src"
+    "$BIN/mocoda-gentu" $shape "$DIR/src"
+    for config in none plugin cg; do
+        i=0
+        while [ $i -lt "$RUNS" ]; do
+            run "$shape" "$config" $i
+            i=$((i + 1))
+        done
+    done
+done
+
+cat "$OUTPUT"
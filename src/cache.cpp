@@ -0,0 +1,66 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include "cache.hxx"
+#include "utils.hxx"
+
+namespace mocoda
+{
+    RecordsCache::RecordsCache(const std::string & __dir) : dir(__dir) { }
+
+    std::string RecordsCache::getPath(const std::uint64_t key) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "/%016llx.rec", static_cast<unsigned long long>(key));
+        return dir + name;
+    }
+
+    bool RecordsCache::load(const std::uint64_t key, Records & records) const
+    {
+        std::ifstream in(getPath(key), std::ios::binary);
+        if (!in)
+        {
+            return false;
+        }
+
+        const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (!records.deserialize(data.data(), data.size()))
+        {
+            records = Records();
+            return false;
+        }
+
+        return true;
+    }
+
+    bool RecordsCache::store(const std::uint64_t key, const Records & records) const
+    {
+        std::string data;
+        records.serialize(data);
+
+        // the file is renamed once written so a concurrent load never sees a partial file
+        const std::string tmp = utils::getUniqueFile(dir, "tmp-", ".rec.tmp");
+        if (tmp.empty())
+        {
+            std::cerr << "Can't create a file in cache: " << dir << std::endl;
+            return false;
+        }
+
+        std::ofstream out(tmp, std::ios::binary);
+        out.write(data.data(), data.size());
+        out.close();
+        if (!out || std::rename(tmp.c_str(), getPath(key).c_str()) != 0)
+        {
+            std::remove(tmp.c_str());
+            return false;
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,40 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __CACHE_HXX__
+#define __CACHE_HXX__
+
+#include <cstdint>
+#include <string>
+
+#include "records.hxx"
+
+namespace mocoda
+{
+    // The records of the TUs already collected, stored in DIR/<key>.rec
+    // where the key is a hash of everything they depend on (see
+    // DataCollector::getCacheKey).
+    class RecordsCache
+    {
+        const std::string dir;
+
+    public:
+
+        RecordsCache(const std::string & __dir);
+
+        operator bool() const
+            {
+                return !dir.empty();
+            }
+
+        bool load(const std::uint64_t key, Records & records) const;
+        bool store(const std::uint64_t key, const Records & records) const;
+
+    private:
+
+        std::string getPath(const std::uint64_t key) const;
+    };
+}
+
+#endif // __CACHE_HXX__
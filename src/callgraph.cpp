@@ -0,0 +1,213 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "callgraph.hxx"
+
+namespace mocoda
+{
+    namespace
+    {
+        bool check(const char * buffer, const format::Header * h)
+        {
+            using namespace format;
+            const std::uint64_t size = h->size;
+            const std::uint32_t n = h->defCount;
+
+            // the strings are followed by the file offsets: the last byte of
+            // the section is a NUL (ending the last string or padding)
+            if (h->strings > h->files || !extent<char>(buffer, size, h->strings, h->files - h->strings)
+                || (h->files > h->strings && buffer[h->files - 1] != '\0'))
+            {
+                return false;
+            }
+            const std::uint64_t strings = h->files - h->strings;
+
+            const std::uint32_t * files = extent<std::uint32_t>(buffer, size, h->files, h->fileCount);
+            const Definition * defs = extent<Definition>(buffer, size, h->defs, n);
+            const std::uint32_t * byName = extent<std::uint32_t>(buffer, size, h->byName, n);
+            const std::uint32_t * calleesIndex = extent<std::uint32_t>(buffer, size, h->calleesIndex, std::uint64_t(n) + 1);
+            const Edge * callees = extent<Edge>(buffer, size, h->callees, h->edgeCount);
+            const std::uint32_t * callersIndex = extent<std::uint32_t>(buffer, size, h->callersIndex, std::uint64_t(n) + 1);
+            const Edge * callers = extent<Edge>(buffer, size, h->callers, h->edgeCount);
+            const std::uint32_t * overridersIndex = extent<std::uint32_t>(buffer, size, h->overridersIndex, std::uint64_t(n) + 1);
+            const std::uint32_t * overriders = extent<std::uint32_t>(buffer, size, h->overriders, h->overrideCount);
+            const std::uint32_t * overriddenIndex = extent<std::uint32_t>(buffer, size, h->overriddenIndex, std::uint64_t(n) + 1);
+            const std::uint32_t * overridden = extent<std::uint32_t>(buffer, size, h->overridden, h->overrideCount);
+            if (!files || !defs || !byName || !calleesIndex || !callees || !callersIndex || !callers
+                || !overridersIndex || !overriders || !overriddenIndex || !overridden)
+            {
+                return false;
+            }
+
+            auto target = [n](const Edge & e) { return e.target < n; };
+            return below(files, h->fileCount, strings)
+                && std::all_of(defs, defs + n, [h, strings](const Definition & d) { return d.file < h->fileCount && d.name < strings; })
+                && below(byName, n, n)
+                && isIndex(calleesIndex, n, h->edgeCount) && std::all_of(callees, callees + h->edgeCount, target)
+                && isIndex(callersIndex, n, h->edgeCount) && std::all_of(callers, callers + h->edgeCount, target)
+                && isIndex(overridersIndex, n, h->overrideCount) && below(overriders, h->overrideCount, n)
+                && isIndex(overriddenIndex, n, h->overrideCount) && below(overridden, h->overrideCount, n);
+        }
+    }
+
+    CallGraph::CallGraph() : map(nullptr), mapSize(0), data(nullptr), header(nullptr) { }
+
+    CallGraph::~CallGraph()
+    {
+        close();
+    }
+
+    bool CallGraph::open(const std::string & path)
+    {
+        close();
+
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+        {
+            std::cerr << "Can't open call graph: " << path << std::endl;
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void * m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (m != MAP_FAILED)
+            {
+                map = m;
+                mapSize = st.st_size;
+            }
+        }
+        ::close(fd);
+
+        if (!map || !load(static_cast<const char *>(map), mapSize))
+        {
+            std::cerr << "Invalid call graph: " << path << std::endl;
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    bool CallGraph::load(const char * buffer, const std::size_t size)
+    {
+        if (size < sizeof(format::Header))
+        {
+            return false;
+        }
+
+        const format::Header * h = reinterpret_cast<const format::Header *>(buffer);
+        if (std::memcmp(h->magic, format::MAGIC, sizeof(format::MAGIC)) != 0
+            || h->version != format::VERSION
+            || h->size > size)
+        {
+            return false;
+        }
+
+        // everything read later is checked once here, so a corrupt or
+        // truncated file is rejected instead of being read out of bounds
+        if (!check(buffer, h))
+        {
+            return false;
+        }
+
+        data = buffer;
+        header = h;
+
+        return true;
+    }
+
+    void CallGraph::close()
+    {
+        if (map)
+        {
+            munmap(map, mapSize);
+            map = nullptr;
+            mapSize = 0;
+        }
+        data = nullptr;
+        header = nullptr;
+    }
+
+    const char * CallGraph::file(const std::uint32_t i) const
+    {
+        return section<char>(header->strings) + section<std::uint32_t>(header->files)[i];
+    }
+
+    const format::Definition & CallGraph::def(const std::uint32_t i) const
+    {
+        return section<format::Definition>(header->defs)[i];
+    }
+
+    const char * CallGraph::name(const std::uint32_t i) const
+    {
+        return section<char>(header->strings) + def(i).name;
+    }
+
+    const char * CallGraph::filename(const std::uint32_t i) const
+    {
+        return file(def(i).file);
+    }
+
+    Range<format::Edge> CallGraph::edges(const std::uint64_t index, const std::uint64_t edges, const std::uint32_t i) const
+    {
+        const std::uint32_t * idx = section<std::uint32_t>(index);
+        const format::Edge * e = section<format::Edge>(edges);
+        return Range<format::Edge>(e + idx[i], e + idx[i + 1]);
+    }
+
+    Range<format::Edge> CallGraph::callees(const std::uint32_t i) const
+    {
+        return edges(header->calleesIndex, header->callees, i);
+    }
+
+    Range<format::Edge> CallGraph::callers(const std::uint32_t i) const
+    {
+        return edges(header->callersIndex, header->callers, i);
+    }
+
+    Range<std::uint32_t> CallGraph::indices(const std::uint64_t index, const std::uint64_t indices, const std::uint32_t i) const
+    {
+        const std::uint32_t * idx = section<std::uint32_t>(index);
+        const std::uint32_t * o = section<std::uint32_t>(indices);
+        return Range<std::uint32_t>(o + idx[i], o + idx[i + 1]);
+    }
+
+    Range<std::uint32_t> CallGraph::overriders(const std::uint32_t i) const
+    {
+        return indices(header->overridersIndex, header->overriders, i);
+    }
+
+    Range<std::uint32_t> CallGraph::overridden(const std::uint32_t i) const
+    {
+        return indices(header->overriddenIndex, header->overridden, i);
+    }
+
+    Range<std::uint32_t> CallGraph::find(const std::string & name) const
+    {
+        const std::uint32_t * first = section<std::uint32_t>(header->byName);
+        const std::uint32_t * last = first + header->defCount;
+        const std::uint32_t * lower = std::lower_bound(first, last, name,
+                                                       [this](const std::uint32_t i, const std::string & s)
+                                                       {
+                                                           return s.compare(this->name(i)) > 0;
+                                                       });
+        const std::uint32_t * upper = std::upper_bound(lower, last, name,
+                                                       [this](const std::string & s, const std::uint32_t i)
+                                                       {
+                                                           return s.compare(this->name(i)) < 0;
+                                                       });
+        return Range<std::uint32_t>(lower, upper);
+    }
+}
@@ -0,0 +1,181 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __CALLGRAPH_HXX__
+#define __CALLGRAPH_HXX__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace mocoda
+{
+    // Layout of the binary call graph written by mocoda-pack.
+    // All the sections are 8-byte aligned arrays of fixed-width records
+    // so the file can be used as is once it has been mmap'ed.
+    namespace format
+    {
+        const char MAGIC[8] = { 'M', 'O', 'C', 'O', 'D', 'A', 'C', 'G' };
+        const std::uint32_t VERSION = 2;
+
+        enum EdgeFlags : std::uint32_t
+        {
+            VIRTUAL = 1,
+        };
+
+        struct Header
+        {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t fileCount;
+            std::uint32_t defCount;
+            std::uint32_t edgeCount;
+            std::uint32_t overrideCount;
+            std::uint32_t reserved;
+            std::uint64_t size;
+            // offsets of the sections from the beginning of the file
+            std::uint64_t strings;          // NUL-terminated strings, up to files
+            std::uint64_t files;            // fileCount offsets in strings
+            std::uint64_t defs;             // defCount Definition
+            std::uint64_t byName;           // defCount indices of defs sorted by name
+            std::uint64_t calleesIndex;     // defCount + 1 indices in callees
+            std::uint64_t callees;          // edgeCount Edge, target is the callee
+            std::uint64_t callersIndex;     // defCount + 1 indices in callers
+            std::uint64_t callers;          // edgeCount Edge, target is the caller
+            std::uint64_t overridersIndex;  // defCount + 1 indices in overriders
+            std::uint64_t overriders;       // overrideCount indices of the defs overriding a def
+            std::uint64_t overriddenIndex;  // defCount + 1 indices in overridden
+            std::uint64_t overridden;       // overrideCount indices of the defs overridden by a def
+        };
+
+        struct Definition
+        {
+            std::uint32_t file;
+            std::uint32_t name;             // offset in strings
+            std::uint32_t begin;
+            std::uint32_t end;
+        };
+
+        struct Edge
+        {
+            std::uint32_t target;
+            std::uint32_t line;
+            std::uint32_t col;
+            std::uint32_t flags;
+        };
+
+        // the checks of an image before it's used (see CallGraph::load):
+        // the section has count records of type T inside the image
+        template<typename T>
+        const T * extent(const char * buffer, const std::uint64_t size, const std::uint64_t offset, const std::uint64_t count)
+        {
+            if (offset > size || offset % alignof(T) != 0 || count > (size - offset) / sizeof(T))
+            {
+                return nullptr;
+            }
+            return reinterpret_cast<const T *>(buffer + offset);
+        }
+
+        inline bool below(const std::uint32_t * values, const std::uint64_t count, const std::uint64_t max)
+        {
+            return std::all_of(values, values + count, [max](const std::uint32_t v) { return v < max; });
+        }
+
+        // n + 1 increasing indices from 0 to count at most
+        template<typename T>
+        bool isIndex(const T * index, const std::uint32_t n, const std::uint64_t count)
+        {
+            if (index[0] != 0 || index[n] > count)
+            {
+                return false;
+            }
+            for (std::uint32_t i = 0; i < n; ++i)
+            {
+                if (index[i] > index[i + 1])
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    template<typename T>
+    class Range
+    {
+        const T * b;
+        const T * e;
+
+    public:
+
+        Range(const T * __b, const T * __e) : b(__b), e(__e) { }
+
+        const T * begin() const { return b; }
+        const T * end() const { return e; }
+        std::size_t size() const { return e - b; }
+        bool empty() const { return b == e; }
+        const T & operator[](const std::size_t i) const { return b[i]; }
+    };
+
+    class CallGraph
+    {
+        void * map;
+        std::size_t mapSize;
+        const char * data;
+        const format::Header * header;
+
+    public:
+
+        CallGraph();
+        ~CallGraph();
+
+        CallGraph(const CallGraph &) = delete;
+        CallGraph & operator=(const CallGraph &) = delete;
+
+        // mmap a file written by mocoda-pack
+        bool open(const std::string & path);
+        // use an image already in memory (it must outlive the CallGraph)
+        bool load(const char * buffer, const std::size_t size);
+        void close();
+
+        operator bool() const
+            {
+                return header != nullptr;
+            }
+
+        // the whole image, e.g. to hash it
+        const char * image() const { return data; }
+        std::uint64_t size() const { return header->size; }
+        std::uint32_t fileCount() const { return header->fileCount; }
+        std::uint32_t defCount() const { return header->defCount; }
+        std::uint32_t edgeCount() const { return header->edgeCount; }
+
+        const char * file(const std::uint32_t i) const;
+        const format::Definition & def(const std::uint32_t i) const;
+        const char * name(const std::uint32_t i) const;
+        const char * filename(const std::uint32_t i) const;
+        Range<format::Edge> callees(const std::uint32_t i) const;
+        Range<format::Edge> callers(const std::uint32_t i) const;
+        // all the methods overriding a method, directly or not: the targets of a virtual call
+        Range<std::uint32_t> overriders(const std::uint32_t i) const;
+        // all the methods overridden by a method, directly or not
+        Range<std::uint32_t> overridden(const std::uint32_t i) const;
+        // all the definitions with the given name
+        Range<std::uint32_t> find(const std::string & name) const;
+
+    private:
+
+        template<typename T>
+        const T * section(const std::uint64_t offset) const
+            {
+                return reinterpret_cast<const T *>(data + offset);
+            }
+
+        Range<format::Edge> edges(const std::uint64_t index, const std::uint64_t edges, const std::uint32_t i) const;
+        Range<std::uint32_t> indices(const std::uint64_t index, const std::uint64_t indices, const std::uint32_t i) const;
+    };
+}
+
+#endif // __CALLGRAPH_HXX__
@@ -0,0 +1,184 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "channel.hxx"
+
+namespace mocoda
+{
+    namespace channel
+    {
+        namespace
+        {
+            const char MAGIC[4] = { 'M', 'O', 'C', 'R' };
+            const std::uint32_t VERSION = 6;
+            const char ACK = 'K';
+            // the size of a frame is checked before allocating its payload
+            const std::uint64_t MAX_SIZE = std::uint64_t(1) << 30;
+
+            struct Frame
+            {
+                char magic[4];
+                std::uint32_t version;
+                std::uint64_t size;
+            };
+
+            bool address(const std::string & path, struct sockaddr_un & addr)
+            {
+                std::memset(&addr, 0, sizeof(addr));
+                addr.sun_family = AF_UNIX;
+                if (path.length() >= sizeof(addr.sun_path))
+                {
+                    std::cerr << "Socket path is too long: " << path << std::endl;
+                    return false;
+                }
+                std::strcpy(addr.sun_path, path.c_str());
+                return true;
+            }
+
+            bool writeAll(const int fd, const char * data, std::size_t size)
+            {
+                while (size)
+                {
+                    const ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+                    if (n < 0)
+                    {
+                        if (errno == EINTR)
+                        {
+                            continue;
+                        }
+                        return false;
+                    }
+                    data += n;
+                    size -= n;
+                }
+                return true;
+            }
+
+            bool readAll(const int fd, char * data, std::size_t size)
+            {
+                while (size)
+                {
+                    const ssize_t n = ::read(fd, data, size);
+                    if (n <= 0)
+                    {
+                        if (n < 0 && errno == EINTR)
+                        {
+                            continue;
+                        }
+                        return false;
+                    }
+                    data += n;
+                    size -= n;
+                }
+                return true;
+            }
+        }
+
+        bool send(const std::string & path, const Records & records)
+        {
+            std::string payload(sizeof(Frame), '\0');
+            records.serialize(payload);
+            if (payload.size() - sizeof(Frame) > MAX_SIZE)
+            {
+                return false;
+            }
+
+            Frame frame;
+            std::memcpy(frame.magic, MAGIC, sizeof(MAGIC));
+            frame.version = VERSION;
+            frame.size = payload.size() - sizeof(Frame);
+            std::memcpy(&payload[0], &frame, sizeof(Frame));
+
+            struct sockaddr_un addr;
+            if (!address(path, addr))
+            {
+                return false;
+            }
+
+            const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd == -1)
+            {
+                return false;
+            }
+
+            if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1)
+            {
+                close(fd);
+                return false;
+            }
+
+            char ack = 0;
+            const bool ok = writeAll(fd, payload.data(), payload.size())
+                && readAll(fd, &ack, 1)
+                && ack == ACK;
+            close(fd);
+
+            return ok;
+        }
+
+        int listen(const std::string & path)
+        {
+            struct sockaddr_un addr;
+            if (!address(path, addr))
+            {
+                return -1;
+            }
+
+            const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd == -1)
+            {
+                return -1;
+            }
+
+            unlink(path.c_str());
+            if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1
+                || ::listen(fd, SOMAXCONN) == -1)
+            {
+                std::cerr << "Can't listen on socket: "
+                          << std::strerror(errno)
+                          << ": " << path
+                          << std::endl;
+                close(fd);
+                return -1;
+            }
+
+            return fd;
+        }
+
+        bool receive(const int fd, Records & records)
+        {
+            Frame frame;
+            if (!readAll(fd, reinterpret_cast<char *>(&frame), sizeof(Frame))
+                || std::memcmp(frame.magic, MAGIC, sizeof(MAGIC)) != 0
+                || frame.version != VERSION)
+            {
+                return false;
+            }
+
+            if (frame.size > MAX_SIZE)
+            {
+                std::cerr << "Invalid frame size: " << frame.size << std::endl;
+                return false;
+            }
+
+            std::string payload(frame.size, '\0');
+            return readAll(fd, &payload[0], payload.size())
+                && records.deserialize(payload.data(), payload.size());
+        }
+
+        bool ack(const int fd)
+        {
+            return writeAll(fd, &ACK, 1);
+        }
+    }
+}
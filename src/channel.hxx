@@ -0,0 +1,32 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __CHANNEL_HXX__
+#define __CHANNEL_HXX__
+
+#include <string>
+
+#include "records.hxx"
+
+namespace mocoda
+{
+    // Transport of the Records of a TU to mocoda-collector over a Unix
+    // domain socket: a client sends one frame (a fixed header followed by
+    // the serialized Records) and waits for a one byte acknowledgment, sent
+    // by the collector once the records are committed. The frames larger
+    // than 1GB are rejected.
+    namespace channel
+    {
+        // client side: return false if the collector isn't reachable or hasn't
+        // acknowledged the records
+        bool send(const std::string & path, const Records & records);
+
+        // server side
+        int listen(const std::string & path);
+        bool receive(const int fd, Records & records);
+        bool ack(const int fd);
+    }
+}
+
+#endif // __CHANNEL_HXX__
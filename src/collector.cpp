@@ -0,0 +1,261 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+// mocoda-collector: receive the Records of the compiler processes (which
+// have MOCODA_SOCKET set) and write them in the database. It owns the only
+// SQLite connection, so the plugin doesn't need MOCODA_LOCK, and header
+// functions coming from many TUs are deduplicated in memory.
+// A TU is acknowledged once the transaction containing its records has
+// been committed: when the daemon dies before, the plugin writes the TU
+// itself (so a TU can be written twice, which is harmless, but is never
+// lost). Each batch is written while holding MOCODA_LOCK, as the plugin
+// does, so the TUs written by the plugin meanwhile don't conflict with it.
+// The received records not yet written are bounded: when the
+// database falls behind, the connections aren't accepted anymore and the
+// compilers wait.
+// The pending records are written and the daemon exits on SIGTERM or SIGINT.
+//
+// Usage: mocoda-collector SOCKET DATABASE
+
+#include <algorithm>
+#include <condition_variable>
+#include <csignal>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "DB.hxx"
+#include "channel.hxx"
+#include "records.hxx"
+#include "utils.hxx"
+
+namespace mocoda
+{
+    namespace
+    {
+        volatile std::sig_atomic_t stop = 0;
+
+        void handleSignal(int)
+        {
+            stop = 1;
+        }
+    }
+
+    class Collector
+    {
+        // the records of a TU and the connection to acknowledge once they're committed
+        struct Pending
+        {
+            Records records;
+            int fd;
+        };
+
+        // max number of rows received and not yet committed
+        static const std::size_t MAX_ROWS = 1 << 20;
+
+        DB db;
+        const std::string lock;
+        std::mutex mutex;
+        std::condition_variable cv;
+        // accepted connections not yet read
+        std::deque<int> connections;
+        // received records not yet written
+        std::deque<Pending> queue;
+        // rows in the queue and in the batch being written
+        std::size_t rows;
+        std::size_t reading;
+        bool done;
+
+    public:
+
+        Collector(const std::string & path) : db(path), lock(utils::getEnv("MOCODA_LOCK")), rows(0), reading(0), done(false)
+        {
+            db.enableCache();
+            // a transaction is open only while the lock is held
+            db.commit();
+        }
+
+        void run(const int server, const unsigned readers);
+
+    private:
+
+        void reader();
+        void writer();
+    };
+
+    void Collector::reader()
+    {
+        for (;;)
+        {
+            int fd;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] { return !connections.empty() || done; });
+                if (connections.empty())
+                {
+                    return;
+                }
+                fd = connections.front();
+                connections.pop_front();
+                ++reading;
+            }
+
+            Records records;
+            const bool ok = channel::receive(fd, records);
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (ok)
+                {
+                    // the bound is checked before adding the TU so a TU larger than it is accepted
+                    cv.wait(lock, [this] { return rows < MAX_ROWS; });
+                    rows += records.size();
+                    queue.push_back({ std::move(records), fd });
+                }
+                --reading;
+            }
+            cv.notify_all();
+
+            if (!ok)
+            {
+                close(fd);
+            }
+        }
+    }
+
+    void Collector::writer()
+    {
+        std::deque<Pending> batch;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] { return !queue.empty() || (done && connections.empty() && !reading); });
+                if (queue.empty())
+                {
+                    return;
+                }
+                // everything received while the previous batch was written
+                // goes in the same transaction
+                batch.swap(queue);
+            }
+
+            const int fd = lock.empty() ? -1 : open(lock.c_str(), O_RDONLY);
+            if (fd != -1 && flock(fd, LOCK_EX) != 0)
+            {
+                std::cerr << "Can't lock: " << lock << std::endl;
+            }
+
+            std::size_t written = 0;
+            db.begin();
+            for (auto && p : batch)
+            {
+                p.records.write(db);
+                written += p.records.size();
+            }
+            db.commit();
+
+            if (fd != -1)
+            {
+                flock(fd, LOCK_UN);
+                close(fd);
+            }
+
+            for (auto && p : batch)
+            {
+                channel::ack(p.fd);
+                close(p.fd);
+            }
+            batch.clear();
+
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                rows -= written;
+            }
+            cv.notify_all();
+        }
+    }
+
+    void Collector::run(const int server, const unsigned readers)
+    {
+        std::vector<std::thread> threads;
+        threads.emplace_back(&Collector::writer, this);
+        for (unsigned i = 0; i < readers; ++i)
+        {
+            threads.emplace_back(&Collector::reader, this);
+        }
+
+        struct pollfd pfd;
+        pfd.fd = server;
+        pfd.events = POLLIN;
+        while (!stop)
+        {
+            bool full;
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                full = rows >= MAX_ROWS;
+            }
+            if (full)
+            {
+                // the compilers wait in the backlog of the socket
+                poll(nullptr, 0, 200);
+            }
+            else if (poll(&pfd, 1, 200) > 0 && (pfd.revents & POLLIN))
+            {
+                const int fd = accept(server, nullptr, nullptr);
+                if (fd != -1)
+                {
+                    {
+                        std::lock_guard<std::mutex> guard(mutex);
+                        connections.push_back(fd);
+                    }
+                    cv.notify_all();
+                }
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            done = true;
+        }
+        cv.notify_all();
+        for (auto && t : threads)
+        {
+            t.join();
+        }
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " SOCKET DATABASE" << std::endl;
+        return 1;
+    }
+
+    const int server = mocoda::channel::listen(argv[1]);
+    if (server == -1)
+    {
+        return 1;
+    }
+
+    std::signal(SIGTERM, mocoda::handleSignal);
+    std::signal(SIGINT, mocoda::handleSignal);
+
+    mocoda::Collector collector(argv[2]);
+    collector.run(server, std::max(2u, std::thread::hardware_concurrency()));
+
+    close(server);
+    unlink(argv[1]);
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "counters.hxx"
+
+namespace mocoda
+{
+    Counters::Counters() : traverse(0), collect(0), lock(0), write(0), commit(0),
+                           definitions(0), declarations(0), calls(0), overrides(0), maxrss(0) { }
+
+    void Counters::setMaxRSS()
+    {
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+        {
+            maxrss = usage.ru_maxrss;
+        }
+    }
+
+    bool Counters::append(const std::string & dir) const
+    {
+        std::ostringstream out;
+        out << tu << '\t'
+            << traverse << '\t'
+            << collect << '\t'
+            << lock << '\t'
+            << write << '\t'
+            << commit << '\t'
+            << definitions << '\t'
+            << declarations << '\t'
+            << calls << '\t'
+            << overrides << '\t'
+            << maxrss << '\n';
+        const std::string line = out.str();
+
+        const std::string path = dir + "/mocoda.stats";
+        const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd == -1)
+        {
+            std::cerr << "Can't open stats file: " << path << std::endl;
+            return false;
+        }
+        const bool ok = ::write(fd, line.data(), line.size()) == ssize_t(line.size());
+        close(fd);
+
+        return ok;
+    }
+
+    bool Counters::parse(const std::string & line)
+    {
+        const std::size_t pos = line.find('\t');
+        if (pos == std::string::npos)
+        {
+            return false;
+        }
+
+        tu = line.substr(0, pos);
+        std::istringstream in(line.substr(pos + 1));
+        in >> traverse >> collect >> lock >> write >> commit
+           >> definitions >> declarations >> calls >> overrides >> maxrss;
+
+        return !in.fail();
+    }
+}
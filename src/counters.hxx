@@ -0,0 +1,64 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __COUNTERS_HXX__
+#define __COUNTERS_HXX__
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace mocoda
+{
+    // What the plugin costs for a TU: when MOCODA_STATS is set, a line is
+    // appended for each TU to MOCODA_STATS/mocoda.stats (see mocoda-stats).
+    struct Counters
+    {
+        std::string tu;
+        // in seconds
+        double traverse;
+        double collect;
+        double lock;
+        double write;
+        double commit;
+        std::uint64_t definitions;
+        std::uint64_t declarations;
+        std::uint64_t calls;
+        std::uint64_t overrides;
+        // in kilobytes
+        std::uint64_t maxrss;
+
+        Counters();
+
+        std::uint64_t emitted() const
+            {
+                return definitions + declarations + calls + overrides;
+            }
+
+        void setMaxRSS();
+        // a single write with O_APPEND so the lines of concurrent TUs aren't mixed
+        bool append(const std::string & dir) const;
+        bool parse(const std::string & line);
+    };
+
+    class Stopwatch
+    {
+        std::chrono::steady_clock::time_point start;
+
+    public:
+
+        Stopwatch() : start(std::chrono::steady_clock::now()) { }
+
+        // the seconds elapsed since the last call (or since the construction)
+        double lap()
+            {
+                const auto now = std::chrono::steady_clock::now();
+                const double s = std::chrono::duration<double>(now - start).count();
+                start = now;
+                return s;
+            }
+    };
+}
+
+#endif // __COUNTERS_HXX__
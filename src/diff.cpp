@@ -0,0 +1,231 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+// mocoda-diff: find the functions touched by a unified diff (see lineindex.hxx).
+//
+// Usage: mocoda-diff [-a AFTER] DATABASE [PATCH]
+//
+//   DATABASE: database of the revision the patch applies to
+//   -a: database of the revision with the patch applied
+//
+// The patch is read from the standard input when PATCH isn't given. The
+// definitions of DATABASE covering a removed line are written with a '-'
+// and the definitions of AFTER covering an added line with a '+'. Without
+// AFTER, a line added between two lines of a definition of DATABASE touches
+// it too.
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "lineindex.hxx"
+
+namespace mocoda
+{
+    typedef std::vector<std::pair<std::uint32_t, std::uint32_t>> Ranges;
+
+    struct FilePatch
+    {
+        std::string oldPath;
+        std::string newPath;
+        Ranges removed;
+        Ranges added;
+        // the lines of the old file before which some lines are added
+        std::vector<std::uint32_t> insertions;
+    };
+
+    namespace
+    {
+        std::string getPath(const std::string & line)
+        {
+            std::string path = line.substr(4, line.find('\t') == std::string::npos ? std::string::npos : line.find('\t') - 4);
+            if (path == "/dev/null")
+            {
+                return "";
+            }
+            if (path.compare(0, 2, "a/") == 0 || path.compare(0, 2, "b/") == 0)
+            {
+                return path.substr(2);
+            }
+            return path;
+        }
+
+        // parse "-start,count" or "+start,count" (the count is 1 when omitted):
+        // when the count is 0, start is the line before the change
+        bool getRange(const std::string & line, const char sign, std::uint32_t & start, std::uint32_t & count)
+        {
+            const std::size_t pos = line.find(sign, 2);
+            if (pos == std::string::npos)
+            {
+                return false;
+            }
+            char * end;
+            start = std::strtoul(line.c_str() + pos + 1, &end, 10);
+            count = *end == ',' ? std::strtoul(end + 1, nullptr, 10) : 1;
+            start += count == 0;
+            return true;
+        }
+
+        void push(Ranges & ranges, const std::uint32_t line)
+        {
+            if (!ranges.empty() && ranges.back().second + 1 == line)
+            {
+                ranges.back().second = line;
+            }
+            else
+            {
+                ranges.emplace_back(line, line);
+            }
+        }
+    }
+
+    std::vector<FilePatch> parse(std::istream & in)
+    {
+        std::vector<FilePatch> patches;
+        std::string oldPath;
+        std::uint32_t oldLine = 0, newLine = 0, oldLeft = 0, newLeft = 0;
+        std::string line;
+        while (std::getline(in, line))
+        {
+            const char c = line.empty() ? ' ' : line[0];
+            if ((oldLeft || newLeft) && (c == '-' || c == '+' || c == ' ' || c == '\\'))
+            {
+                FilePatch & p = patches.back();
+                if (c == '-')
+                {
+                    push(p.removed, oldLine++);
+                    oldLeft -= oldLeft != 0;
+                }
+                else if (c == '+')
+                {
+                    push(p.added, newLine++);
+                    if (p.insertions.empty() || p.insertions.back() != oldLine)
+                    {
+                        p.insertions.push_back(oldLine);
+                    }
+                    newLeft -= newLeft != 0;
+                }
+                else if (c == ' ')
+                {
+                    ++oldLine;
+                    ++newLine;
+                    oldLeft -= oldLeft != 0;
+                    newLeft -= newLeft != 0;
+                }
+                continue;
+            }
+
+            // the hunk is over (or has been truncated)
+            oldLeft = newLeft = 0;
+
+            if (line.compare(0, 4, "--- ") == 0)
+            {
+                oldPath = getPath(line);
+            }
+            else if (line.compare(0, 4, "+++ ") == 0)
+            {
+                patches.emplace_back();
+                patches.back().oldPath = oldPath;
+                patches.back().newPath = getPath(line);
+            }
+            else if (line.compare(0, 3, "@@ ") == 0 && !patches.empty())
+            {
+                if (!getRange(line, '-', oldLine, oldLeft) || !getRange(line, '+', newLine, newLeft))
+                {
+                    std::cerr << "Invalid hunk: " << line << std::endl;
+                    oldLeft = newLeft = 0;
+                }
+            }
+        }
+
+        return patches;
+    }
+
+    void print(const LineIndex & index, const std::vector<std::uint32_t> & defs, const char side)
+    {
+        for (auto && i : defs)
+        {
+            const Info & d = index.def(i);
+            std::cout << side << '\t' << d.funname << '\t' << d.filename << ':' << d.begin << '-' << d.end << '\n';
+        }
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    const char * after = nullptr;
+    int opt;
+    while ((opt = getopt(argc, argv, "a:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'a': after = optarg; break;
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-a AFTER] DATABASE [PATCH]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (optind >= argc || optind + 2 < argc)
+    {
+        std::cerr << "Usage: " << argv[0] << " [-a AFTER] DATABASE [PATCH]" << std::endl;
+        return 1;
+    }
+
+    mocoda::LineIndex before, afterIndex;
+    if (!before.load(argv[optind]) || (after && !afterIndex.load(after)))
+    {
+        return 1;
+    }
+
+    std::vector<mocoda::FilePatch> patches;
+    if (optind + 1 < argc)
+    {
+        std::ifstream in(argv[optind + 1]);
+        if (!in)
+        {
+            std::cerr << "Can't open patch: " << argv[optind + 1] << std::endl;
+            return 1;
+        }
+        patches = mocoda::parse(in);
+    }
+    else
+    {
+        patches = mocoda::parse(std::cin);
+    }
+
+    for (auto && p : patches)
+    {
+        std::vector<std::uint32_t> defs = before.touched(p.oldPath, p.removed);
+        if (after)
+        {
+            mocoda::print(before, defs, '-');
+            mocoda::print(afterIndex, afterIndex.touched(p.newPath, p.added), '+');
+            continue;
+        }
+
+        // the definitions containing the lines around an insertion
+        for (auto && line : p.insertions)
+        {
+            for (auto && i : before.enclosing(p.oldPath, line))
+            {
+                if (before.def(i).begin < line)
+                {
+                    defs.push_back(i);
+                }
+            }
+        }
+        std::sort(defs.begin(), defs.end());
+        defs.erase(std::unique(defs.begin(), defs.end()), defs.end());
+        mocoda::print(before, defs, '-');
+    }
+
+    return 0;
+}
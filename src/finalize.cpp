@@ -0,0 +1,29 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+// mocoda-finalize: move the rows appended to the raw_ tables when
+// MOCODA_BULK is set into the tables with the usual schema. The rows are
+// deduplicated and linked once with set-based queries instead of paying
+// for the constraints and the lookups in each compiler process.
+//
+// Usage: mocoda-finalize DATABASE
+
+#include <iostream>
+
+#include "DB.hxx"
+
+int main(int argc, char ** argv)
+{
+    if (argc != 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " DATABASE" << std::endl;
+        return 1;
+    }
+
+    mocoda::DB db(argv[1], false);
+    db.finalize();
+    db.commit();
+
+    return 0;
+}
@@ -0,0 +1,109 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __FLATMAP_HXX__
+#define __FLATMAP_HXX__
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace mocoda
+{
+    // Open addressing hash map (linear probing) keyed by pointers: the keys
+    // and the values are stored in two flat arrays so there is no allocation
+    // per element. nullptr can't be used as a key and there is no erase.
+    // The pointers returned by find and emplace are invalidated by the next
+    // insertion.
+    template<typename K, typename V>
+    class FlatMap
+    {
+        std::vector<K> keys;
+        std::vector<V> values;
+        std::size_t count;
+
+    public:
+
+        FlatMap() : keys(16, nullptr), values(16), count(0) { }
+
+        std::size_t size() const
+            {
+                return count;
+            }
+
+        V * find(const K key)
+            {
+                const std::size_t pos = lookup(key);
+                return keys[pos] ? &values[pos] : nullptr;
+            }
+
+        std::pair<V *, bool> emplace(const K key, const V & value)
+            {
+                if ((count + 1) * 4 > keys.size() * 3)
+                {
+                    grow();
+                }
+
+                const std::size_t pos = lookup(key);
+                if (keys[pos])
+                {
+                    return std::make_pair(&values[pos], false);
+                }
+
+                keys[pos] = key;
+                values[pos] = value;
+                ++count;
+                return std::make_pair(&values[pos], true);
+            }
+
+        V & operator[](const K key)
+            {
+                return *emplace(key, V()).first;
+            }
+
+    private:
+
+        std::size_t lookup(const K key) const
+            {
+                const std::size_t mask = keys.size() - 1;
+                std::size_t pos = hash(key) & mask;
+                while (keys[pos] && keys[pos] != key)
+                {
+                    pos = (pos + 1) & mask;
+                }
+                return pos;
+            }
+
+        static std::size_t hash(const K key)
+            {
+                std::uint64_t x = reinterpret_cast<std::uintptr_t>(key);
+                x ^= x >> 33;
+                x *= 0xff51afd7ed558ccdULL;
+                x ^= x >> 33;
+                return x;
+            }
+
+        void grow()
+            {
+                std::vector<K> previousKeys;
+                std::vector<V> previousValues;
+                previousKeys.swap(keys);
+                previousValues.swap(values);
+                keys.assign(previousKeys.size() * 2, nullptr);
+                values.resize(previousValues.size() * 2);
+                for (std::size_t i = 0; i < previousKeys.size(); ++i)
+                {
+                    if (previousKeys[i])
+                    {
+                        const std::size_t pos = lookup(previousKeys[i]);
+                        keys[pos] = previousKeys[i];
+                        values[pos] = std::move(previousValues[i]);
+                    }
+                }
+            }
+    };
+}
+
+#endif // __FLATMAP_HXX__
@@ -0,0 +1,212 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+// mocoda-gentu: generate synthetic TUs to benchmark the plugin (see bench.sh).
+//
+// Usage: mocoda-gentu [-t TUS] [-f FUNCTIONS] [-d DEPTH] [-v VIRTUALS]
+//                     [-c CALLS] [-h HEADERS] [-i INCLUDES] [-s SEED] DIRECTORY
+//
+//   -t: number of TUs
+//   -f: number of functions defined in each TU
+//   -d: depth of the recursive template instantiated in each header
+//   -v: depth of the class hierarchy with virtual methods in each header
+//   -c: number of calls in each function
+//   -h: number of headers
+//   -i: number of headers included by each TU (fan-in)
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+namespace mocoda
+{
+    struct Shape
+    {
+        unsigned tus;
+        unsigned functions;
+        unsigned depth;
+        unsigned virtuals;
+        unsigned calls;
+        unsigned headers;
+        unsigned includes;
+        std::uint32_t seed;
+
+        Shape() : tus(8), functions(100), depth(8), virtuals(4), calls(4), headers(8), includes(4), seed(1) { }
+    };
+
+    class Generator
+    {
+        const Shape & shape;
+        std::uint32_t state;
+
+    public:
+
+        Generator(const Shape & __shape) : shape(__shape), state(__shape.seed) { }
+
+        bool write(const std::string & dir);
+
+    private:
+
+        // a LCG is enough and makes the output the same everywhere
+        unsigned random(const unsigned n)
+            {
+                state = state * 1103515245u + 12345u;
+                return (state >> 16) % n;
+            }
+
+        void header(std::ostream & out, const unsigned h);
+        void tu(std::ostream & out, const unsigned t);
+    };
+
+    void Generator::header(std::ostream & out, const unsigned h)
+    {
+        out << "#ifndef __H" << h << "_HXX__\n"
+            << "#define __H" << h << "_HXX__\n\n"
+            << "namespace h" << h << "\n{\n";
+
+        out << "    template<int N>\n"
+            << "    struct Chain\n    {\n"
+            << "        static int run(int x) { return Chain<N - 1>::run(x) + N; }\n"
+            << "    };\n\n"
+            << "    template<>\n"
+            << "    struct Chain<0>\n    {\n"
+            << "        static int run(int x) { return x; }\n"
+            << "    };\n\n";
+
+        out << "    struct Base0\n    {\n"
+            << "        virtual ~Base0() { }\n"
+            << "        virtual int f(int x) { return x; }\n"
+            << "        virtual int g(int x) const = 0;\n"
+            << "    };\n\n";
+        for (unsigned v = 1; v <= shape.virtuals; ++v)
+        {
+            out << "    struct Base" << v << " : Base" << v - 1 << "\n    {\n"
+                << "        int f(int x) override { return Base" << v - 1 << "::f(x) + " << v << "; }\n"
+                << "        int g(int x) const override { return x * " << v << "; }\n"
+                << "    };\n\n";
+        }
+
+        for (unsigned i = 0; i < shape.calls; ++i)
+        {
+            out << "    inline int helper" << i << "(int x) { return Chain<" << shape.depth << ">::run(x) + " << i << "; }\n";
+        }
+
+        out << "}\n\n#endif\n";
+    }
+
+    void Generator::tu(std::ostream & out, const unsigned t)
+    {
+        for (unsigned i = 0; i < shape.includes && i < shape.headers; ++i)
+        {
+            out << "#include \"h" << (t + i) % shape.headers << ".hxx\"\n";
+        }
+
+        out << "\nnamespace tu" << t << "\n{\n";
+        for (unsigned f = 0; f < shape.functions; ++f)
+        {
+            out << "    int f" << f << "(int x);\n";
+        }
+        out << '\n';
+
+        for (unsigned f = 0; f < shape.functions; ++f)
+        {
+            out << "    int f" << f << "(int x)\n    {\n"
+                << "        int r = x;\n";
+            for (unsigned c = 0; c < shape.calls; ++c)
+            {
+                const unsigned h = shape.includes ? (t + random(std::min(shape.includes, shape.headers))) % shape.headers : 0;
+                switch (shape.includes ? random(3) : 0)
+                {
+                case 0:
+                    out << "        r += f" << random(shape.functions) << "(r ^ " << c << ");\n";
+                    break;
+                case 1:
+                    out << "        r += h" << h << "::helper" << random(shape.calls) << "(r);\n";
+                    break;
+                default:
+                    out << "        {\n"
+                        << "            h" << h << "::Base" << shape.virtuals << " b;\n"
+                        << "            h" << h << "::Base0 & v = b;\n"
+                        << "            r += v.f(r) + v.g(r);\n"
+                        << "        }\n";
+                    break;
+                }
+            }
+            out << "        return r;\n    }\n\n";
+        }
+        out << "}\n";
+    }
+
+    bool Generator::write(const std::string & dir)
+    {
+        for (unsigned h = 0; h < shape.headers; ++h)
+        {
+            const std::string path = dir + "/h" + std::to_string(h) + ".hxx";
+            std::ofstream out(path);
+            header(out, h);
+            if (!out)
+            {
+                std::cerr << "Can't write: " << path << std::endl;
+                return false;
+            }
+        }
+
+        for (unsigned t = 0; t < shape.tus; ++t)
+        {
+            const std::string path = dir + "/tu" + std::to_string(t) + ".cpp";
+            std::ofstream out(path);
+            tu(out, t);
+            if (!out)
+            {
+                std::cerr << "Can't write: " << path << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    mocoda::Shape shape;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:f:d:v:c:h:i:s:")) != -1)
+    {
+        const unsigned n = std::strtoul(optarg, nullptr, 10);
+        switch (opt)
+        {
+        case 't': shape.tus = n; break;
+        case 'f': shape.functions = n ? n : 1; break;
+        case 'd': shape.depth = n; break;
+        case 'v': shape.virtuals = n; break;
+        case 'c': shape.calls = n; break;
+        case 'h': shape.headers = n; break;
+        case 'i': shape.includes = n; break;
+        case 's': shape.seed = n; break;
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-t TUS] [-f FUNCTIONS] [-d DEPTH] [-v VIRTUALS] [-c CALLS] [-h HEADERS] [-i INCLUDES] [-s SEED] DIRECTORY" << std::endl;
+            return 1;
+        }
+    }
+
+    if (!shape.headers)
+    {
+        shape.includes = 0;
+    }
+
+    if (optind + 1 != argc)
+    {
+        std::cerr << "Usage: " << argv[0] << " [-t TUS] [-f FUNCTIONS] [-d DEPTH] [-v VIRTUALS] [-c CALLS] [-h HEADERS] [-i INCLUDES] [-s SEED] DIRECTORY" << std::endl;
+        return 1;
+    }
+
+    mocoda::Generator generator(shape);
+    return generator.write(argv[optind]) ? 0 : 1;
+}
@@ -0,0 +1,368 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "DB.hxx"
+#include "graphbuilder.hxx"
+#include "reader.hxx"
+
+namespace mocoda
+{
+    namespace
+    {
+        const std::uint32_t NONE = std::uint32_t(-1);
+
+        template<typename K>
+        std::uint32_t get(const std::unordered_map<K, std::uint32_t> & map, const K id)
+        {
+            auto i = map.find(id);
+            return i == map.end() ? NONE : i->second;
+        }
+
+        template<typename T>
+        std::uint64_t append(std::vector<char> & image, const T * data, const std::size_t count)
+        {
+            image.resize((image.size() + 7) & ~std::size_t(7), 0);
+            const std::uint64_t offset = image.size();
+            const char * p = reinterpret_cast<const char *>(data);
+            image.insert(image.end(), p, p + count * sizeof(T));
+            return offset;
+        }
+
+        template<typename T>
+        std::uint64_t append(std::vector<char> & image, const std::vector<T> & data)
+        {
+            return append(image, data.data(), data.size());
+        }
+
+        template<typename Target, typename Source>
+        void csr(const std::size_t n, const std::vector<Source> & items, Target && target,
+                 std::vector<std::uint32_t> & index, std::vector<std::uint32_t> & order)
+        {
+            index.assign(n + 1, 0);
+            for (auto && i : items)
+            {
+                ++index[target(i) + 1];
+            }
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                index[i + 1] += index[i];
+            }
+            std::vector<std::uint32_t> pos(index.begin(), index.end() - 1);
+            order.resize(items.size());
+            for (std::uint32_t i = 0; i < items.size(); ++i)
+            {
+                order[pos[target(items[i])]++] = i;
+            }
+        }
+
+        typedef std::pair<std::uint32_t, std::uint32_t> Override;
+
+        // the pairs (method, overridden method) for all the methods overridden
+        // directly or not, from the direct pairs written by the plugin
+        std::vector<Override> closure(const std::size_t n, const std::vector<Override> & direct)
+        {
+            std::vector<std::uint32_t> index, order;
+            csr(n, direct, [](const Override & o) { return o.first; }, index, order);
+
+            std::vector<Override> all;
+            // mark[i] is m + 1 when i has been reached from m
+            std::vector<std::uint32_t> mark(n, 0), stack;
+            for (std::uint32_t m = 0; m < n; ++m)
+            {
+                stack.assign(1, m);
+                mark[m] = m + 1;
+                while (!stack.empty())
+                {
+                    const std::uint32_t i = stack.back();
+                    stack.pop_back();
+                    for (std::uint32_t k = index[i]; k < index[i + 1]; ++k)
+                    {
+                        const std::uint32_t o = direct[order[k]].second;
+                        if (mark[o] != m + 1)
+                        {
+                            mark[o] = m + 1;
+                            all.emplace_back(m, o);
+                            stack.push_back(o);
+                        }
+                    }
+                }
+            }
+
+            return all;
+        }
+    }
+
+    std::string GraphBuilder::shortName(const std::string & name)
+    {
+        std::string s;
+        s.reserve(name.size());
+        for (std::size_t i = 0; i < name.size(); ++i)
+        {
+            if (name[i] == ' ' && i + 1 < name.size() && (name[i + 1] == '*' || name[i + 1] == '&'))
+            {
+                continue;
+            }
+            s.push_back(name[i]);
+            if (name[i] == ',' && i + 1 < name.size() && name[i + 1] == ' ')
+            {
+                ++i;
+            }
+        }
+        return s;
+    }
+
+    bool GraphBuilder::load(const std::string & path)
+    {
+        Reader reader(path);
+        if (!reader)
+        {
+            return false;
+        }
+
+        defs.clear();
+        calls.clear();
+        overrides.clear();
+
+        std::unordered_map<RowId, std::uint32_t> defMap;
+        std::unordered_map<RowId, std::uint32_t> declMap;
+        std::unordered_map<std::string, std::uint32_t> byName;
+        std::unordered_map<std::uint64_t, std::uint32_t> byId;
+
+        bool ok = reader.forEach("SELECT d.ROWID,f.NAME,IFNULL(n.NAME,''),d.BEGIN,d.END,d.ID FROM definitions d "
+                                 "JOIN files f ON f.ROWID=d.FILE LEFT JOIN names n ON n.ROWID=d.NAME ORDER BY d.ROWID;", [&](sqlite3_stmt * stmt)
+                                 {
+                                     const std::uint32_t index = defs.size();
+                                     defs.emplace_back(Reader::getInfo(stmt, 1));
+                                     defMap.emplace(sqlite3_column_int64(stmt, 0), index);
+                                     if (defs.back().id)
+                                     {
+                                         byId.emplace(defs.back().id, index);
+                                     }
+                                     auto r = byName.emplace(shortName(defs.back().funname), index);
+                                     if (!r.second)
+                                     {
+                                         r.first->second = NONE;
+                                     }
+                                 });
+
+        // the overridden methods which are only declared (e.g. pure virtual methods):
+        // they're in the graph so the virtual calls to them can be dispatched
+        std::unordered_set<RowId> virtualDecls;
+        ok = ok && reader.forEach("SELECT DISTINCT VDEC FROM overrides_unresolved;", [&](sqlite3_stmt * stmt)
+                                  {
+                                      virtualDecls.insert(sqlite3_column_int64(stmt, 0));
+                                  });
+
+        ok = ok && reader.forEach("SELECT d.ROWID,f.NAME,IFNULL(n.NAME,''),d.BEGIN,d.END,d.ID,d.DEF FROM declarations d "
+                                  "JOIN files f ON f.ROWID=d.FILE LEFT JOIN names n ON n.ROWID=d.NAME;", [&](sqlite3_stmt * stmt)
+                                  {
+                                      const RowId rowid = sqlite3_column_int64(stmt, 0);
+                                      std::uint32_t def = NONE;
+                                      if (sqlite3_column_type(stmt, 6) != SQLITE_NULL)
+                                      {
+                                          def = get(defMap, sqlite3_column_int64(stmt, 6));
+                                      }
+                                      else if (const std::uint64_t id = sqlite3_column_int64(stmt, 5))
+                                      {
+                                          // the declaration and the definition of a function have the same id
+                                          def = get(byId, id);
+                                      }
+                                      else
+                                      {
+                                          // try to resolve the name
+                                          auto i = byName.find(shortName(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2))));
+                                          if (i != byName.end())
+                                          {
+                                              def = i->second;
+                                          }
+                                      }
+                                      if (def == NONE && virtualDecls.count(rowid))
+                                      {
+                                          def = defs.size();
+                                          defs.emplace_back(Reader::getInfo(stmt, 1));
+                                      }
+                                      if (def != NONE)
+                                      {
+                                          declMap.emplace(rowid, def);
+                                      }
+                                  });
+
+        auto addCalls = [&](const char * sql, const std::unordered_map<RowId, std::uint32_t> & calleeMap)
+            {
+                return reader.forEach(sql, [&](sqlite3_stmt * stmt)
+                                      {
+                                          const std::uint32_t caller = get(defMap, sqlite3_column_int64(stmt, 0));
+                                          const std::uint32_t callee = get(calleeMap, sqlite3_column_int64(stmt, 1));
+                                          if (caller != NONE && callee != NONE)
+                                          {
+                                              calls.push_back({ caller, callee,
+                                                          std::uint32_t(sqlite3_column_int64(stmt, 2)),
+                                                          std::uint32_t(sqlite3_column_int64(stmt, 3)),
+                                                          sqlite3_column_int(stmt, 4) ? format::VIRTUAL : 0u });
+                                          }
+                                      });
+            };
+
+        ok = ok && addCalls("SELECT * FROM callgraph_resolved;", defMap);
+        ok = ok && addCalls("SELECT * FROM callgraph_unresolved;", declMap);
+
+        auto addOverrides = [&](const char * sql, const std::unordered_map<RowId, std::uint32_t> & vMap)
+            {
+                return reader.forEach(sql, [&](sqlite3_stmt * stmt)
+                                      {
+                                          const std::uint32_t def = get(defMap, sqlite3_column_int64(stmt, 0));
+                                          const std::uint32_t vdef = get(vMap, sqlite3_column_int64(stmt, 1));
+                                          if (def != NONE && vdef != NONE && def != vdef)
+                                          {
+                                              overrides.emplace_back(def, vdef);
+                                          }
+                                      });
+            };
+
+        ok = ok && addOverrides("SELECT * FROM overrides_resolved;", defMap);
+        ok = ok && addOverrides("SELECT * FROM overrides_unresolved;", declMap);
+
+        std::sort(overrides.begin(), overrides.end());
+        overrides.erase(std::unique(overrides.begin(), overrides.end()), overrides.end());
+        // the tables have the methods overridden directly (and the ones reached through
+        // a method which is only declared) and the graph all of them, so a virtual call
+        // is dispatched with a single lookup
+        overrides = closure(defs.size(), overrides);
+
+        return ok;
+    }
+
+    std::vector<char> GraphBuilder::build() const
+    {
+        std::vector<char> strings;
+        std::unordered_map<std::string, std::uint32_t> stringIds;
+        auto intern = [&](const std::string & s)
+            {
+                auto r = stringIds.emplace(s, strings.size());
+                if (r.second)
+                {
+                    strings.insert(strings.end(), s.c_str(), s.c_str() + s.size() + 1);
+                }
+                return r.first->second;
+            };
+
+        std::vector<std::uint32_t> files;
+        std::unordered_map<std::string, std::uint32_t> fileIds;
+        std::vector<format::Definition> records;
+        records.reserve(defs.size());
+        for (auto && d : defs)
+        {
+            auto r = fileIds.emplace(d.filename, files.size());
+            if (r.second)
+            {
+                files.push_back(intern(d.filename));
+            }
+            records.push_back({ r.first->second, intern(d.funname), std::uint32_t(d.begin), std::uint32_t(d.end) });
+        }
+
+        std::vector<std::uint32_t> byName(defs.size());
+        for (std::uint32_t i = 0; i < byName.size(); ++i)
+        {
+            byName[i] = i;
+        }
+        std::sort(byName.begin(), byName.end(), [&](const std::uint32_t a, const std::uint32_t b)
+                  {
+                      return std::strcmp(strings.data() + records[a].name, strings.data() + records[b].name) < 0;
+                  });
+
+        std::vector<std::uint32_t> calleesIndex, callersIndex, order;
+        std::vector<format::Edge> callees, callers;
+        csr(defs.size(), calls, [](const Call & c) { return c.caller; }, calleesIndex, order);
+        for (auto && i : order)
+        {
+            const Call & c = calls[i];
+            callees.push_back({ c.callee, c.line, c.col, c.flags });
+        }
+        csr(defs.size(), calls, [](const Call & c) { return c.callee; }, callersIndex, order);
+        for (auto && i : order)
+        {
+            const Call & c = calls[i];
+            callers.push_back({ c.caller, c.line, c.col, c.flags });
+        }
+
+        std::vector<std::uint32_t> overridersIndex, overridersOrder, overridersList;
+        std::vector<std::uint32_t> overriddenIndex, overriddenOrder, overriddenList;
+        csr(defs.size(), overrides, [](const Override & o) { return o.second; }, overridersIndex, overridersOrder);
+        for (auto && i : overridersOrder)
+        {
+            overridersList.push_back(overrides[i].first);
+        }
+        csr(defs.size(), overrides, [](const Override & o) { return o.first; }, overriddenIndex, overriddenOrder);
+        for (auto && i : overriddenOrder)
+        {
+            overriddenList.push_back(overrides[i].second);
+        }
+
+        format::Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, format::MAGIC, sizeof(format::MAGIC));
+        header.version = format::VERSION;
+        header.fileCount = files.size();
+        header.defCount = defs.size();
+        header.edgeCount = calls.size();
+        header.overrideCount = overrides.size();
+
+        std::vector<char> image(sizeof(header), 0);
+        header.strings = append(image, strings);
+        header.files = append(image, files);
+        header.defs = append(image, records);
+        header.byName = append(image, byName);
+        header.calleesIndex = append(image, calleesIndex);
+        header.callees = append(image, callees);
+        header.callersIndex = append(image, callersIndex);
+        header.callers = append(image, callers);
+        header.overridersIndex = append(image, overridersIndex);
+        header.overriders = append(image, overridersList);
+        header.overriddenIndex = append(image, overriddenIndex);
+        header.overridden = append(image, overriddenList);
+        image.resize((image.size() + 7) & ~std::size_t(7), 0);
+        header.size = image.size();
+        std::memcpy(image.data(), &header, sizeof(header));
+
+        return image;
+    }
+
+    bool GraphBuilder::write(const std::string & path) const
+    {
+        const std::vector<char> image = build();
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(image.data(), image.size());
+        if (!out)
+        {
+            std::cerr << "Can't write call graph: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool GraphBuilder::open(const std::string & path, CallGraph & graph, std::vector<char> & image)
+    {
+        char magic[sizeof(format::MAGIC)];
+        std::ifstream in(path, std::ios::binary);
+        if (in.read(magic, sizeof(magic)) && std::memcmp(magic, format::MAGIC, sizeof(magic)) == 0)
+        {
+            return graph.open(path);
+        }
+
+        GraphBuilder builder;
+        if (!builder.load(path))
+        {
+            return false;
+        }
+        image = builder.build();
+        return graph.load(image.data(), image.size());
+    }
+}
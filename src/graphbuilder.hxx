@@ -0,0 +1,52 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __GRAPHBUILDER_HXX__
+#define __GRAPHBUILDER_HXX__
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "callgraph.hxx"
+#include "info.hxx"
+
+namespace mocoda
+{
+    // Build the image of a CallGraph from the tables written by DB:
+    // unresolved calls and overrides are resolved with the DEF column of
+    // the declarations or, when it's NULL, with the only definition having
+    // the same name (as finalizedb does). The overridden methods without a
+    // definition are added to the graph so a virtual call to them is kept,
+    // and the overrides of the graph are the transitive closure of the
+    // direct overrides of the tables.
+    class GraphBuilder
+    {
+        struct Call
+        {
+            std::uint32_t caller;
+            std::uint32_t callee;
+            std::uint32_t line;
+            std::uint32_t col;
+            std::uint32_t flags;
+        };
+
+        std::vector<Info> defs;
+        std::vector<Call> calls;
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> overrides;
+
+    public:
+
+        bool load(const std::string & path);
+        std::vector<char> build() const;
+        bool write(const std::string & path) const;
+
+        static std::string shortName(const std::string & name);
+        // open a file written by mocoda-pack or build the graph of a database in image
+        static bool open(const std::string & path, CallGraph & graph, std::vector<char> & image);
+    };
+}
+
+#endif // __GRAPHBUILDER_HXX__
@@ -2,19 +2,35 @@
 // License, v. 2.0. If a copy of the MPL was not distributed with this file,
 // You can obtain one at http://mozilla.org/MPL/2.0/.
 
+#include <functional>
+
 #include "info.hxx"
 
 namespace mocoda
 {
     Info::Info(const std::string & __filename, const std::string & __funname,
-               const std::size_t __begin, const std::size_t __end) : filename(__filename),
-                                                                     funname(__funname),
-                                                                     begin(__begin),
-                                                                     end(__end) { }
+               const std::size_t __begin, const std::size_t __end,
+               const std::uint64_t __id) : filename(__filename),
+                                           funname(__funname),
+                                           begin(__begin),
+                                           end(__end),
+                                           id(__id) { }
     Info::Info() : filename(""),
                    funname(""),
                    begin(1),
-                   end(0) { }
+                   end(0),
+                   id(0) { }
+
+    std::size_t InfoHash::operator()(const Info & i) const
+    {
+        std::hash<std::string> h;
+        std::size_t seed = h(i.filename);
+        seed ^= h(i.funname) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        seed ^= i.begin + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        seed ^= i.end + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        seed ^= i.id + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        return seed;
+    }
 }
     
 std::ostream & operator<<(std::ostream & os, const mocoda::Info & i)
@@ -22,7 +38,8 @@ std::ostream & operator<<(std::ostream & os, const mocoda::Info & i)
     os << "File: " << i.filename << '\n'
        << "Function: " << i.funname << '\n'
        << "Begin: " << i.begin << '\n'
-       << "End: " << i.end;
+       << "End: " << i.end << '\n'
+       << "Id: " << i.id;
     
     return os;
 }
@@ -5,6 +5,7 @@
 #ifndef __INFO_HXX__
 #define __INFO_HXX__
 
+#include <cstdint>
 #include <iostream>
 #include <string>
 
@@ -16,14 +17,26 @@ namespace mocoda
         std::string funname;
         std::size_t begin;
         std::size_t end;
+        // stable identity of the function (0 if MOCODA_ID isn't set)
+        std::uint64_t id;
 
-        Info(const std::string & __filename, const std::string & __funname, const std::size_t __begin, const std::size_t __end);
+        Info(const std::string & __filename, const std::string & __funname, const std::size_t __begin, const std::size_t __end, const std::uint64_t __id = 0);
         Info();
 
         operator bool() const
             {
                 return begin <= end;
             }
+
+        bool operator==(const Info & other) const
+            {
+                return id == other.id && begin == other.begin && end == other.end && filename == other.filename && funname == other.funname;
+            }
+    };
+
+    struct InfoHash
+    {
+        std::size_t operator()(const Info & i) const;
     };
 }
 
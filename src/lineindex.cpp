@@ -0,0 +1,183 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+
+#include "lineindex.hxx"
+#include "reader.hxx"
+
+namespace mocoda
+{
+    const std::uint32_t LineIndex::NONE;
+
+    bool LineIndex::load(const std::string & path)
+    {
+        Reader reader(path);
+        if (!reader)
+        {
+            return false;
+        }
+
+        defs.clear();
+        const bool ok = reader.forEach("SELECT f.NAME,IFNULL(n.NAME,''),d.BEGIN,d.END,d.ID FROM definitions d "
+                                       "JOIN files f ON f.ROWID=d.FILE LEFT JOIN names n ON n.ROWID=d.NAME ORDER BY d.ROWID;", [&](sqlite3_stmt * stmt)
+                                       {
+                                           defs.emplace_back(Reader::getInfo(stmt, 0));
+                                       });
+        build();
+
+        return ok;
+    }
+
+    void LineIndex::add(const Info & info)
+    {
+        defs.push_back(info);
+    }
+
+    void LineIndex::build()
+    {
+        std::unordered_map<std::string, std::vector<std::uint32_t>> byFile;
+        for (std::uint32_t i = 0; i < defs.size(); ++i)
+        {
+            if (defs[i])
+            {
+                byFile[defs[i].filename].push_back(i);
+            }
+        }
+
+        parents.assign(defs.size(), NONE);
+        files.clear();
+        std::vector<std::uint32_t> stack;
+        for (auto && p : byFile)
+        {
+            std::vector<std::uint32_t> & order = p.second;
+            std::sort(order.begin(), order.end(), [this](const std::uint32_t a, const std::uint32_t b)
+                      {
+                          if (defs[a].begin != defs[b].begin)
+                          {
+                              return defs[a].begin < defs[b].begin;
+                          }
+                          if (defs[a].end != defs[b].end)
+                          {
+                              return defs[a].end > defs[b].end;
+                          }
+                          return a < b;
+                      });
+
+            std::vector<Segment> & segs = files[p.first];
+            auto emit = [&segs](const std::uint32_t begin, const std::uint32_t def)
+                {
+                    if (!segs.empty() && segs.back().begin == begin)
+                    {
+                        segs.back().def = def;
+                        if (segs.size() >= 2 && segs[segs.size() - 2].def == def)
+                        {
+                            segs.pop_back();
+                        }
+                    }
+                    else if (segs.empty() || segs.back().def != def)
+                    {
+                        segs.push_back({ begin, def });
+                    }
+                };
+            auto top = [&stack]()
+                {
+                    return stack.empty() ? NONE : stack.back();
+                };
+
+            // the ends of the definitions in the stack are decreasing so the
+            // segments are emitted in the order of the lines
+            stack.clear();
+            for (auto && i : order)
+            {
+                while (!stack.empty() && defs[stack.back()].end < defs[i].end)
+                {
+                    const std::uint32_t t = stack.back();
+                    stack.pop_back();
+                    if (defs[t].end < defs[i].begin)
+                    {
+                        emit(defs[t].end + 1, top());
+                    }
+                }
+                parents[i] = top();
+                emit(defs[i].begin, i);
+                stack.push_back(i);
+            }
+            while (!stack.empty())
+            {
+                const std::uint32_t t = stack.back();
+                stack.pop_back();
+                emit(defs[t].end + 1, top());
+            }
+        }
+    }
+
+    const std::vector<LineIndex::Segment> * LineIndex::segments(const std::string & filename) const
+    {
+        auto i = files.find(filename);
+        return i == files.end() ? nullptr : &i->second;
+    }
+
+    std::uint32_t LineIndex::innermost(const std::string & filename, const std::uint32_t line) const
+    {
+        const std::vector<Segment> * segs = segments(filename);
+        if (!segs)
+        {
+            return NONE;
+        }
+
+        auto i = std::upper_bound(segs->begin(), segs->end(), line, [](const std::uint32_t l, const Segment & s)
+                                  {
+                                      return l < s.begin;
+                                  });
+        return i == segs->begin() ? NONE : (i - 1)->def;
+    }
+
+    std::vector<std::uint32_t> LineIndex::enclosing(const std::string & filename, const std::uint32_t line) const
+    {
+        std::vector<std::uint32_t> result;
+        for (std::uint32_t i = innermost(filename, line); i != NONE; i = parents[i])
+        {
+            result.push_back(i);
+        }
+        return result;
+    }
+
+    std::vector<std::uint32_t> LineIndex::touched(const std::string & filename, std::vector<std::pair<std::uint32_t, std::uint32_t>> ranges) const
+    {
+        std::vector<std::uint32_t> result;
+        const std::vector<Segment> * segs = segments(filename);
+        if (!segs)
+        {
+            return result;
+        }
+
+        std::sort(ranges.begin(), ranges.end());
+        auto i = segs->begin();
+        for (auto && r : ranges)
+        {
+            // the segment containing the first line of the range
+            i = std::upper_bound(i, segs->end(), r.first, [](const std::uint32_t l, const Segment & s)
+                                 {
+                                     return l < s.begin;
+                                 });
+            if (i != segs->begin())
+            {
+                --i;
+            }
+            for (; i != segs->end() && i->begin <= r.second; ++i)
+            {
+                for (std::uint32_t d = i->def; d != NONE; d = parents[d])
+                {
+                    result.push_back(d);
+                }
+            }
+        }
+
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+
+        return result;
+    }
+}
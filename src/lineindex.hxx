@@ -0,0 +1,68 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __LINEINDEX_HXX__
+#define __LINEINDEX_HXX__
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "info.hxx"
+
+namespace mocoda
+{
+    // Map the lines of the files to the definitions covering them.
+    // The definitions of a file are sorted by their first line and form a
+    // nesting tree (lambdas and methods of local classes are children of the
+    // function containing them). The lines of a file are split in segments
+    // having the same innermost definition, so a line is found with a binary
+    // search and its enclosing definitions are the ancestors of the innermost
+    // one. When two definitions overlap without being nested, the one
+    // beginning last is the innermost.
+    class LineIndex
+    {
+        struct Segment
+        {
+            // first line of the segment
+            std::uint32_t begin;
+            std::uint32_t def;
+        };
+
+        std::vector<Info> defs;
+        std::vector<std::uint32_t> parents;
+        // segments of each file, sorted by their first line
+        std::unordered_map<std::string, std::vector<Segment>> files;
+
+    public:
+
+        static const std::uint32_t NONE = std::uint32_t(-1);
+
+        // load the definitions of a database written by DB
+        bool load(const std::string & path);
+        void add(const Info & info);
+        // must be called after the definitions have been added
+        void build();
+
+        std::uint32_t defCount() const { return defs.size(); }
+        const Info & def(const std::uint32_t i) const { return defs[i]; }
+        std::uint32_t parent(const std::uint32_t i) const { return parents[i]; }
+        bool hasFile(const std::string & filename) const { return files.count(filename) != 0; }
+
+        // the innermost definition covering a line (NONE if none)
+        std::uint32_t innermost(const std::string & filename, const std::uint32_t line) const;
+        // the definitions covering a line from the innermost to the outermost
+        std::vector<std::uint32_t> enclosing(const std::string & filename, const std::uint32_t line) const;
+        // the definitions covering a line of one of the ranges [first, last], sorted by index
+        std::vector<std::uint32_t> touched(const std::string & filename, std::vector<std::pair<std::uint32_t, std::uint32_t>> ranges) const;
+
+    private:
+
+        const std::vector<Segment> * segments(const std::string & filename) const;
+    };
+}
+
+#endif // __LINEINDEX_HXX__
@@ -0,0 +1,150 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+// mocoda-merge: merge the per-TU shards written by the plugin when
+// MOCODA_SHARDS is set into a single database with the usual schema.
+//
+// Usage: mocoda-merge OUTPUT SHARD_OR_DIRECTORY...
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+#include <sys/stat.h>
+
+#include "DB.hxx"
+#include "reader.hxx"
+#include "utils.hxx"
+
+namespace mocoda
+{
+    class ShardMerger
+    {
+        typedef std::unordered_map<RowId, RowId> RowMap;
+
+        DB & db;
+
+    public:
+
+        ShardMerger(DB & __db) : db(__db) { }
+
+        bool merge(const std::string & path);
+
+    private:
+
+        static RowId get(const RowMap & map, const RowId id);
+    };
+
+    RowId ShardMerger::get(const RowMap & map, const RowId id)
+    {
+        auto i = map.find(id);
+        return i == map.end() ? 0 : i->second;
+    }
+
+    bool ShardMerger::merge(const std::string & path)
+    {
+        Reader shard(path);
+        if (!shard)
+        {
+            return false;
+        }
+
+        RowMap defMap;
+        RowMap declMap;
+        bool ok = shard.forEach("SELECT d.ROWID,f.NAME,IFNULL(n.NAME,''),d.BEGIN,d.END,d.ID FROM definitions d "
+                                "JOIN files f ON f.ROWID=d.FILE LEFT JOIN names n ON n.ROWID=d.NAME;", [&](sqlite3_stmt * stmt)
+                           {
+                               defMap.emplace(sqlite3_column_int64(stmt, 0), db.insertDefinition(Reader::getInfo(stmt, 1)));
+                           });
+
+        ok = ok && shard.forEach("SELECT d.ROWID,f.NAME,IFNULL(n.NAME,''),d.BEGIN,d.END,d.ID,d.DEF FROM declarations d "
+                                 "JOIN files f ON f.ROWID=d.FILE LEFT JOIN names n ON n.ROWID=d.NAME;", [&](sqlite3_stmt * stmt)
+                           {
+                               const RowId def = get(defMap, sqlite3_column_int64(stmt, 6));
+                               declMap.emplace(sqlite3_column_int64(stmt, 0), db.insertDeclaration(Reader::getInfo(stmt, 1), def));
+                           });
+
+        ok = ok && shard.forEach("SELECT * FROM callgraph_resolved;", [&](sqlite3_stmt * stmt)
+                           {
+                               db.insertCallResolved(get(defMap, sqlite3_column_int64(stmt, 0)),
+                                                     get(defMap, sqlite3_column_int64(stmt, 1)),
+                                                     sqlite3_column_int64(stmt, 2),
+                                                     sqlite3_column_int64(stmt, 3),
+                                                     sqlite3_column_int(stmt, 4));
+                           });
+
+        ok = ok && shard.forEach("SELECT * FROM callgraph_unresolved;", [&](sqlite3_stmt * stmt)
+                           {
+                               db.insertCallUnresolved(get(defMap, sqlite3_column_int64(stmt, 0)),
+                                                       get(declMap, sqlite3_column_int64(stmt, 1)),
+                                                       sqlite3_column_int64(stmt, 2),
+                                                       sqlite3_column_int64(stmt, 3),
+                                                       sqlite3_column_int(stmt, 4));
+                           });
+
+        ok = ok && shard.forEach("SELECT * FROM overrides_resolved;", [&](sqlite3_stmt * stmt)
+                           {
+                               db.insertVirtualResolved(get(defMap, sqlite3_column_int64(stmt, 0)),
+                                                        get(defMap, sqlite3_column_int64(stmt, 1)));
+                           });
+
+        ok = ok && shard.forEach("SELECT * FROM overrides_unresolved;", [&](sqlite3_stmt * stmt)
+                           {
+                               db.insertVirtualUnresolved(get(defMap, sqlite3_column_int64(stmt, 0)),
+                                                          get(declMap, sqlite3_column_int64(stmt, 1)));
+                           });
+
+        ok = ok && shard.forEach("SELECT t.DEF,t.COUNT,IFNULL(n.NAME,'') FROM templates t LEFT JOIN names n ON n.ROWID=t.SAMPLE;", [&](sqlite3_stmt * stmt)
+                           {
+                               const char * sample = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2));
+                               db.insertTemplate(get(defMap, sqlite3_column_int64(stmt, 0)),
+                                                 sqlite3_column_int64(stmt, 1),
+                                                 sample ? sample : "");
+                           });
+
+        ok = ok && shard.forEach("SELECT * FROM bodies;", [&](sqlite3_stmt * stmt)
+                           {
+                               db.insertBody(get(defMap, sqlite3_column_int64(stmt, 0)), sqlite3_column_int64(stmt, 1));
+                           });
+
+        return ok;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " OUTPUT SHARD_OR_DIRECTORY..." << std::endl;
+        return 1;
+    }
+
+    mocoda::DB db(argv[1]);
+    db.enableCache();
+    mocoda::ShardMerger merger(db);
+    int ret = 0;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        struct stat st;
+        if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            for (auto && path : utils::listFiles(argv[i], ".sqlite"))
+            {
+                if (!merger.merge(path))
+                {
+                    ret = 1;
+                }
+            }
+        }
+        else if (!merger.merge(argv[i]))
+        {
+            ret = 1;
+        }
+    }
+
+    db.commit();
+
+    return ret;
+}
@@ -0,0 +1,29 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+// mocoda-pack: write the binary call graph (see callgraph.hxx) built from
+// the tables of a database, to be mmap'ed with CallGraph::open.
+//
+// Usage: mocoda-pack DATABASE OUTPUT
+
+#include <iostream>
+
+#include "graphbuilder.hxx"
+
+int main(int argc, char ** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " DATABASE OUTPUT" << std::endl;
+        return 1;
+    }
+
+    mocoda::GraphBuilder builder;
+    if (!builder.load(argv[1]) || !builder.write(argv[2]))
+    {
+        return 1;
+    }
+
+    return 0;
+}
@@ -2,29 +2,151 @@
 // License, v. 2.0. If a copy of the MPL was not distributed with this file,
 // You can obtain one at http://mozilla.org/MPL/2.0/.
 
+#include <algorithm>
+#include <cerrno>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <tuple>
+#include <unordered_map>
 
 #include <sys/file.h>
 #include <unistd.h>
 
+#include "channel.hxx"
 #include "utils.hxx"
 #include "plugin.hxx"
 
 namespace mocoda
 {
 
+    namespace
+    {
+        const InfoRef INVALID_INFO = { 0, 0, 1, 0, 0 };
+
+        void dedup(std::vector<Records::Call> & calls)
+        {
+            auto key = [](const Records::Call & c)
+                {
+                    return std::make_tuple(c.caller, c.callee, c.line, c.col, c.isvirtual);
+                };
+            std::sort(calls.begin(), calls.end(), [&](const Records::Call & a, const Records::Call & b)
+                      {
+                          return key(a) < key(b);
+                      });
+            calls.erase(std::unique(calls.begin(), calls.end(), [&](const Records::Call & a, const Records::Call & b)
+                                    {
+                                        return key(a) == key(b);
+                                    }),
+                        calls.end());
+        }
+
+        // the collector whose writer thread may be running: clang usually
+        // doesn't free it (-disable-free) so the thread is joined at exit
+        DataCollector * running = nullptr;
+        bool registered = false;
+
+        void joinRunning()
+        {
+            if (running)
+            {
+                running->join();
+            }
+        }
+    }
+
     DataCollector::DataCollector(clang::CompilerInstance & __CI) : CI(__CI), sm(CI.getSourceManager()),
                                                                    policy(CI.getASTContext().getPrintingPolicy()),
                                                                    root(utils::getEnv("MOCODA_ROOT")),
+                                                                   includes(utils::split(utils::getEnv("MOCODA_INCLUDE"), ':')),
+                                                                   excludes(utils::split(utils::getEnv("MOCODA_EXCLUDE"), ':')),
                                                                    lock(utils::getEnv("MOCODA_LOCK")),
-                                                                   cg(utils::getEnv("MOCODA_CG"))
+                                                                   cg(utils::getEnv("MOCODA_CG")),
+                                                                   shards(utils::getEnv("MOCODA_SHARDS")),
+                                                                   socket(utils::getEnv("MOCODA_SOCKET")),
+                                                                   stats(utils::getEnv("MOCODA_STATS")),
+                                                                   useId(!utils::getEnv("MOCODA_ID").empty()),
+                                                                   useHash(!utils::getEnv("MOCODA_HASH").empty()),
+                                                                   async(!utils::getEnv("MOCODA_ASYNC").empty()),
+                                                                   collapse(!utils::getEnv("MOCODA_COLLAPSE").empty()),
+                                                                   external(!utils::getEnv("MOCODA_EXTERNAL").empty()),
+                                                                   mangler(CI.getASTContext().createMangleContext()),
+                                                                   registry(utils::getEnv("MOCODA_REGISTRY")),
+                                                                   cache(utils::getEnv("MOCODA_CACHE"))
     {
         const_cast<clang::PrintingPolicy &>(policy).SuppressTagKeyword = true;
     }
 
-    std::tuple<std::string, std::size_t, std::size_t> DataCollector::getFileRange(const clang::FunctionDecl * decl, const bool checkSrc) const
+    DataCollector::~DataCollector()
+    {
+        // the writer thread uses the members
+        join();
+        if (running == this)
+        {
+            running = nullptr;
+        }
+    }
+
+    void DataCollector::join()
+    {
+        if (writer.joinable())
+        {
+            writer.join();
+        }
+    }
+
+    DataCollector::FileInfo DataCollector::getFileInfo(const clang::FileEntry * entry)
+    {
+        if (const FileInfo * i = cacheFile.find(entry))
+        {
+            return *i;
+        }
+
+        const std::string rpath = utils::getRealPath(entry->getName());
+        FileInfo info = { strings.intern(rpath), 0 };
+        if (utils::startswith(rpath, root))
+        {
+            const std::string tpath = rpath.substr(root.length());
+            if ((includes.empty() || utils::match(tpath, includes)) && !utils::match(tpath, excludes))
+            {
+                info.rpath = strings.intern(tpath);
+            }
+        }
+
+        cacheFile.emplace(entry, info);
+        return info;
+    }
+
+    bool DataCollector::isExternal(const clang::Decl * decl) const
+    {
+        // the PCH or the module has been collected when it has been built
+        return !external && decl->isFromASTFile();
+    }
+
+    bool DataCollector::isPruned(const clang::Decl * decl)
+    {
+        // only the top-level declarations are pruned: a namespace can be
+        // reopened in any file so we look at what it contains
+        if (clang::isa<clang::TranslationUnitDecl>(decl)
+            || clang::isa<clang::NamespaceDecl>(decl)
+            || clang::isa<clang::LinkageSpecDecl>(decl)
+            || !decl->getDeclContext()->getRedeclContext()->isFileContext())
+        {
+            return false;
+        }
+
+        const clang::SourceLocation loc = sm.getExpansionLoc(decl->getSourceRange().getBegin());
+        if (loc.isInvalid())
+        {
+            return false;
+        }
+
+        const clang::FileEntry * entry = sm.getFileEntryForID(sm.getFileID(loc));
+        return entry && !getFileInfo(entry).rpath;
+    }
+
+    std::tuple<std::uint32_t, std::size_t, std::size_t> DataCollector::getFileRange(const clang::FunctionDecl * decl, const bool checkSrc)
     {
         const clang::SourceRange range = decl->getSourceRange();
         const clang::SourceLocation beginLoc = sm.getExpansionLoc(range.getBegin());
@@ -33,30 +155,18 @@ namespace mocoda
 
         if (entry && range.isValid())
         {
-            const std::string rpath = utils::getRealPath(entry->getName());
-            std::string tpath;
-            if (checkSrc)
-            {
-                if (utils::startswith(rpath, root))
-                {
-                    tpath = rpath.substr(root.length());
-                }
-            }
-            else
-            {
-                tpath = rpath;
-            }
-
-            if (!tpath.empty())
+            const FileInfo file = getFileInfo(entry);
+            const std::uint32_t path = checkSrc ? file.rpath : file.path;
+            if (path)
             {
                 const clang::SourceLocation endLoc = sm.getExpansionLoc(range.getEnd());
-                return std::make_tuple(tpath,
+                return std::make_tuple(path,
                                        sm.getExpansionLineNumber(beginLoc),
                                        sm.getExpansionLineNumber(endLoc));
             }
         }
 
-        return std::make_tuple("", 0, 0);
+        return std::make_tuple(0, 0, 0);
     }
 
     std::pair<std::size_t, std::size_t> DataCollector::getLineColumn(const clang::Expr * expr)
@@ -94,66 +204,188 @@ namespace mocoda
         return nullptr;
     }
     
-    Info DataCollector::getVirtualInfo(const clang::FunctionDecl * decl, const bool checkSrc)
+    InfoRef DataCollector::getVirtualInfo(const clang::FunctionDecl * decl, const bool checkSrc)
     {
         if (const clang::FunctionDecl * virt = getFirstVirtualDecl(decl))
         {
             return getInfo(virt, checkSrc);
         }
-        return Info();
+        return INVALID_INFO;
     }
-    
-    Info DataCollector::getInfo(const clang::FunctionDecl * decl, const bool checkSrc)
+
+    const clang::FunctionDecl * DataCollector::getNode(const clang::FunctionDecl * decl)
     {
-        auto i = cacheInfo.find(decl);
-        if (i == cacheInfo.end())
+        if (collapse)
         {
-            const auto fn = getFileRange(decl, checkSrc);
-            if (!std::get<0>(fn).empty() && std::get<1>(fn) && std::get<2>(fn))
+            if (const clang::FunctionDecl * pattern = decl->getTemplateInstantiationPattern())
             {
-                std::string s;
-                llvm::raw_string_ostream out(s);
-                decl->getNameForDiagnostic(out, policy, true);
-                out << '(';
-                bool first = true;
-                for (auto && parameter : decl->parameters())
-                {
-                    if (!first)
-                    {
-                        out << ", ";
-                    }
-                    else
-                    {
-                        first = false;
-                    }
-                    clang::QualType qtype = parameter->getOriginalType();
-                    const clang::Type * type = qtype.getTypePtrOrNull();
-                    if (type && type->isDependentType())
-                    {
-                        return cacheInfo.emplace(decl, Info()).first->second;
-                    }
-                    out << qtype.getDesugaredType(decl->getASTContext()).getAsString(policy);
-                }
-                out << ')';
+                // the pattern of a member function can be its declaration in the class
+                const clang::FunctionDecl * body = getBody(pattern);
+                return body ? body : pattern;
+            }
+        }
+        return decl;
+    }
 
-                if (decl->getType()->getAs<clang::FunctionType>()->isConst())
-                {
-                    out << " const";
-                }
+    Info DataCollector::toInfo(const InfoRef & info) const
+    {
+        return Info(strings.str(info.filename), strings.str(info.funname), info.begin, info.end, info.id);
+    }
+
+    bool DataCollector::hasDependentParameter(const clang::FunctionDecl * decl)
+    {
+        for (auto && parameter : decl->parameters())
+        {
+            const clang::Type * type = parameter->getOriginalType().getTypePtrOrNull();
+            if (type && type->isDependentType())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
 
-                return cacheInfo.emplace(decl,
-                                         Info(std::get<0>(fn),
-                                              out.str(),
-                                              std::get<1>(fn),
-                                              std::get<2>(fn))).first->second;
+    std::string DataCollector::getName(const clang::FunctionDecl * decl)
+    {
+        std::string s;
+        llvm::raw_string_ostream out(s);
+        decl->getNameForDiagnostic(out, policy, true);
+        out << '(';
+        bool first = true;
+        for (auto && parameter : decl->parameters())
+        {
+            if (!first)
+            {
+                out << ", ";
             }
+            else
+            {
+                first = false;
+            }
+            out << parameter->getOriginalType().getDesugaredType(decl->getASTContext()).getAsString(policy);
+        }
+        out << ')';
+
+        if (decl->getType()->getAs<clang::FunctionType>()->isConst())
+        {
+            out << " const";
+        }
+
+        return out.str();
+    }
+
+    std::uint64_t DataCollector::getId(const clang::FunctionDecl * decl, const std::uint32_t file)
+    {
+        if (decl->isDependentContext())
+        {
+            return 0;
+        }
+
+        std::string s;
+        llvm::raw_string_ostream out(s);
+        if (const clang::CXXConstructorDecl * ctor = clang::dyn_cast<clang::CXXConstructorDecl>(decl))
+        {
+            mangler->mangleCXXCtor(ctor, clang::Ctor_Complete, out);
+        }
+        else if (const clang::CXXDestructorDecl * dtor = clang::dyn_cast<clang::CXXDestructorDecl>(decl))
+        {
+            mangler->mangleCXXDtor(dtor, clang::Dtor_Complete, out);
+        }
+        else if (mangler->shouldMangleDeclName(decl))
+        {
+            mangler->mangleName(decl, out);
         }
         else
         {
-            return i->second;
+            out << decl->getNameAsString();
         }
+        out.flush();
 
-        return cacheInfo.emplace(decl, Info()).first->second;
+        std::uint64_t id = utils::hash64(s.data(), s.size());
+        if (!decl->isExternallyVisible())
+        {
+            // several TUs can have their own function with this name
+            const std::string path = strings.str(file);
+            id = utils::hash64(path.data(), path.size(), id);
+        }
+
+        return id ? id : 1;
+    }
+
+    std::uint64_t DataCollector::getBodyHash(const clang::FunctionDecl * decl)
+    {
+        // the spellings of the tokens are hashed so the hash doesn't depend
+        // on the whitespaces, the comments or the position in the file
+        const clang::SourceRange range = decl->getSourceRange();
+        const clang::SourceLocation beginLoc = sm.getExpansionLoc(range.getBegin());
+        const clang::SourceLocation endLoc = sm.getExpansionLoc(range.getEnd());
+        const clang::FileID id = sm.getFileID(beginLoc);
+        bool invalid = false;
+        const llvm::StringRef buffer = sm.getBufferData(id, &invalid);
+        if (invalid || range.isInvalid() || id != sm.getFileID(endLoc))
+        {
+            return 0;
+        }
+
+        const unsigned last = sm.getFileOffset(endLoc);
+        clang::Lexer lexer(sm.getLocForStartOfFile(id), CI.getLangOpts(), buffer.begin(), buffer.begin() + sm.getFileOffset(beginLoc), buffer.end());
+        clang::Token token;
+        std::uint64_t hash = utils::hash64(nullptr, 0);
+        bool atEnd = false;
+        while (!atEnd)
+        {
+            atEnd = lexer.LexFromRawLexer(token);
+            const unsigned offset = sm.getFileOffset(token.getLocation());
+            if (token.is(clang::tok::eof) || offset > last)
+            {
+                break;
+            }
+            // the length separates the tokens
+            const std::uint32_t length = token.getLength();
+            hash = utils::hash64(&length, sizeof(length), hash);
+            hash = utils::hash64(buffer.data() + offset, length, hash);
+        }
+
+        return hash ? hash : 1;
+    }
+
+    InfoRef DataCollector::getInfo(const clang::FunctionDecl * decl, const bool checkSrc)
+    {
+        if (const InfoRef * i = cacheInfo.find(decl))
+        {
+            return *i;
+        }
+
+        const auto fn = getFileRange(decl, checkSrc);
+        // the templates are only recorded when the instantiations are collapsed
+        if (std::get<0>(fn) && std::get<1>(fn) && std::get<2>(fn) && (collapse || !hasDependentParameter(decl)))
+        {
+            InfoRef info = { std::get<0>(fn),
+                             0,
+                             std::uint32_t(std::get<1>(fn)),
+                             std::uint32_t(std::get<2>(fn)),
+                             useId ? getId(decl, std::get<0>(fn)) : 0 };
+            if (!info.id)
+            {
+                info.funname = strings.intern(getName(decl));
+            }
+            return *cacheInfo.emplace(decl, info).first;
+        }
+
+        return *cacheInfo.emplace(decl, INVALID_INFO).first;
+    }
+
+    InfoRef DataCollector::getNamedInfo(const clang::FunctionDecl * decl)
+    {
+        getInfo(decl, true);
+        InfoRef & info = *cacheInfo.find(decl);
+        if (info && !info.funname)
+        {
+            // rendering the name is expensive so it's only done for
+            // the functions which are written
+            info.funname = strings.intern(getName(decl));
+        }
+        return info;
     }
 
     bool DataCollector::isContainedInAClassTemplate(clang::FunctionDecl * decl)
@@ -237,27 +469,38 @@ namespace mocoda
 
     void DataCollector::handleFunctionDecl(const clang::FunctionDecl * decl)
     {
-        if (!decl->isDeleted())
+        if (!decl->isDeleted() && !defToDecl.find(decl))
         {
-            auto i = defToDecl.find(decl);
-            if (i == defToDecl.end())
+            // the declarations are appended to the shared vector and
+            // they're dropped if the function isn't handled
+            const std::uint32_t first = declarations.size();
+            clang::FunctionDecl * declWithBody = getBody(decl, declarations);
+            if (declWithBody && !defToDecl.find(declWithBody))
             {
-                Declarations declarations;
-                if (clang::FunctionDecl * declWithBody = getBody(decl, declarations))
+                if (clang::FunctionTemplateDecl * fd = declWithBody->getDescribedFunctionTemplate())
                 {
-                    if (clang::FunctionTemplateDecl * fd = declWithBody->getDescribedFunctionTemplate())
-                    {
-                        handleFunctionTemplateDecl(fd);
-                    }
-                    else if (getInfo(declWithBody, true))
+                    declarations.resize(first);
+                    handleFunctionTemplateDecl(fd);
+                    return;
+                }
+                else if (InfoRef info = getInfo(declWithBody, true))
+                {
+                    if (!isExternal(declWithBody)
+                        && (!registry || sm.isInMainFile(sm.getExpansionLoc(declWithBody->getLocation()))
+                            || registry.insert(info.id ? info.id : Registry::hash(toInfo(info)))))
                     {
-                        defToDecl.emplace(declWithBody, declarations);
+                        defToDecl.emplace(declWithBody, definitions.size());
+                        definitions.push_back({ declWithBody, first, std::uint32_t(declarations.size()) });
                         stack.push(declWithBody);
                         Super::TraverseFunctionDecl(declWithBody);
                         stack.pop();
+                        return;
                     }
+                    // else the body has already been collected in another TU
+                    collectedElsewhere.emplace(declWithBody, true);
                 }
             }
+            declarations.resize(first);
         }
     }
 
@@ -297,7 +540,7 @@ namespace mocoda
             const clang::FunctionDecl * caller = stack.top();
             if (clang::FunctionDecl * callee = clang::dyn_cast<clang::FunctionDecl>(d))
             {
-                if (Info info = getInfo(callee, true))
+                if (getInfo(callee, true))
                 {
                     if (const clang::FunctionDecl * calleeWithBody = getBody(callee))
                     {
@@ -318,7 +561,7 @@ namespace mocoda
         return true;
     }
 
-    bool DataCollector::VisitLambdaExpr(clang::LambdaExpr * expr)
+    bool DataCollector::VisitLambdaExpr(clang::LambdaExpr *)
     {
         return true;
     }
@@ -336,6 +579,17 @@ namespace mocoda
         return true;
     }
 
+    bool DataCollector::TraverseDecl(clang::Decl * decl)
+    {
+        if (decl && (isExternal(decl) || isPruned(decl)))
+        {
+            // nothing to collect from a file out of the root or excluded,
+            // or from a PCH or a module
+            return true;
+        }
+        return Super::TraverseDecl(decl);
+    }
+
     bool DataCollector::TraverseFunctionDecl(clang::FunctionDecl * decl)
     {
         if (!decl->isDeleted() && !isContainedInAClassTemplate(decl))
@@ -365,84 +619,354 @@ namespace mocoda
         return TraverseFunctionDecl(decl);
     }
 
-    void DataCollector::pushVirtualInfo(DB & db, const clang::FunctionDecl * decl)
+    std::uint32_t DataCollector::getDefinitionIndex(Records & records, const clang::FunctionDecl * decl)
+    {
+        if (const std::uint32_t * i = defIds.find(decl))
+        {
+            return *i;
+        }
+
+        std::uint32_t index = Records::NONE;
+        // the TU which has collected the body writes the name so it's
+        // useless to render it here when the function has an id
+        if (InfoRef info = collectedElsewhere.find(decl) ? getInfo(decl, true) : getNamedInfo(decl))
+        {
+            index = records.definitions.size();
+            records.definitions.emplace_back(toInfo(info));
+        }
+        defIds.emplace(decl, index);
+        return index;
+    }
+
+    std::uint32_t DataCollector::getDeclarationIndex(Records & records, const clang::FunctionDecl * decl, const std::uint32_t def)
+    {
+        if (const std::uint32_t * i = declIds.find(decl))
+        {
+            if (def != Records::NONE && *i != Records::NONE)
+            {
+                records.declarations[*i].def = def;
+            }
+            return *i;
+        }
+
+        std::uint32_t index = Records::NONE;
+        if (InfoRef info = getNamedInfo(decl))
+        {
+            index = records.declarations.size();
+            records.declarations.push_back({ toInfo(info), def });
+        }
+        declIds.emplace(decl, index);
+        return index;
+    }
+
+    void DataCollector::pushVirtualInfo(Records & records, const clang::FunctionDecl * decl)
     {
         if (const clang::CXXMethodDecl * cmd = clang::dyn_cast<clang::CXXMethodDecl>(decl))
         {
-            Info info = getInfo(decl, true);
-            for (auto && o : cmd->overridden_methods())
+            // only the methods overridden directly are recorded and the transitive
+            // closure is computed by GraphBuilder: but a method which isn't defined
+            // here is never visited, so the methods it overrides are recorded too
+            // else the chain would be broken (e.g. a pure method in the middle)
+            const std::uint32_t index = getDefinitionIndex(records, getNode(decl));
+            std::vector<const clang::CXXMethodDecl *> todo(cmd->begin_overridden_methods(), cmd->end_overridden_methods());
+            std::vector<const clang::CXXMethodDecl *> seen;
+            while (!todo.empty())
             {
-                if (!o->isDeleted() && !o->isDefaulted())
+                const clang::CXXMethodDecl * o = todo.back();
+                todo.pop_back();
+                if (std::find(seen.begin(), seen.end(), o) != seen.end() || o->isDeleted() || o->isDefaulted())
                 {
-                    if (o->doesThisDeclarationHaveABody())
-                    {
-                        if (Info oInfo = getInfo(o, true))
-                        {
-                            db.insertDefinition(oInfo);
-                            db.insertVirtualResolved(info, oInfo);
-                        }
-                    }
-                    else
+                    continue;
+                }
+                seen.push_back(o);
+
+                if (o->doesThisDeclarationHaveABody())
+                {
+                    records.overridesResolved.push_back({ index, getDefinitionIndex(records, getNode(o)) });
+                }
+                else
+                {
+                    records.overridesUnresolved.push_back({ index, getDeclarationIndex(records, getNode(o)) });
+                }
+
+                if (!o->isDefined())
+                {
+                    todo.insert(todo.end(), o->begin_overridden_methods(), o->end_overridden_methods());
+                }
+            }
+        }
+    }
+
+    void DataCollector::pushBodyHash(Records & records, const clang::FunctionDecl * decl, const std::uint32_t def)
+    {
+        if (useHash && def != Records::NONE)
+        {
+            if (const std::uint64_t hash = getBodyHash(decl))
+            {
+                records.bodies.push_back({ def, hash });
+            }
+        }
+    }
+
+    void DataCollector::collect(Records & records)
+    {
+        // index in records.templates of a template definition
+        std::unordered_map<std::uint32_t, std::uint32_t> templates;
+        for (auto && i : definitions)
+        {
+            const clang::FunctionDecl * node = getNode(i.decl);
+            const std::uint32_t def = getDefinitionIndex(records, node);
+            if (node == i.decl)
+            {
+                for (std::uint32_t j = i.firstDecl; j < i.lastDecl; ++j)
+                {
+                    getDeclarationIndex(records, declarations[j], def);
+                }
+                pushBodyHash(records, node, def);
+            }
+            else if (def != Records::NONE)
+            {
+                auto r = templates.emplace(def, records.templates.size());
+                if (r.second)
+                {
+                    records.templates.push_back({ def, 0, getName(i.decl) });
+                    pushBodyHash(records, node, def);
+                    for (auto && rd : node->redecls())
                     {
-                        if (Info oInfo = getInfo(o, true))
+                        if (!rd->doesThisDeclarationHaveABody() && !rd->isDeleted() && !rd->isDefaulted())
                         {
-                            db.insertDeclaration(oInfo);
-                            db.insertVirtualUnresolved(info, oInfo);
+                            getDeclarationIndex(records, rd, def);
                         }
                     }
                 }
+                ++records.templates[r.first->second].count;
+            }
+        }
+
+        if (!cg.empty())
+        {
+            for (auto && i : callgraph_resolved)
+            {
+                const auto lc = getLineColumn(std::get<2>(i));
+                records.callsResolved.push_back({ getDefinitionIndex(records, getNode(std::get<0>(i))),
+                                                  getDefinitionIndex(records, getNode(std::get<1>(i))),
+                                                  std::uint32_t(lc.first), std::uint32_t(lc.second),
+                                                  isVirtual(std::get<1>(i)) });
+            }
+
+            for (auto && i : callgraph_unresolved)
+            {
+                const auto lc = getLineColumn(std::get<2>(i));
+                records.callsUnresolved.push_back({ getDefinitionIndex(records, getNode(std::get<0>(i))),
+                                                    getDeclarationIndex(records, getNode(std::get<1>(i))),
+                                                    std::uint32_t(lc.first), std::uint32_t(lc.second),
+                                                    isVirtual(std::get<1>(i)) });
+            }
+
+            if (collapse)
+            {
+                // the instantiations of a template have the same calls
+                dedup(records.callsResolved);
+                dedup(records.callsUnresolved);
             }
         }
+
+        for (auto && i : definitions)
+        {
+            pushVirtualInfo(records, i.decl);
+        }
     }
-    
-    void DataCollector::push()
+
+    void DataCollector::release()
+    {
+        // everything is in the records now
+        callgraph_resolved = std::vector<Edge>();
+        callgraph_unresolved = std::vector<Edge>();
+        definitions = std::vector<Definition>();
+        declarations = Declarations();
+        defToDecl = FlatMap<const clang::FunctionDecl *, std::uint32_t>();
+        cacheInfo = FlatMap<const clang::FunctionDecl *, InfoRef>();
+        defIds = FlatMap<const clang::FunctionDecl *, std::uint32_t>();
+        declIds = FlatMap<const clang::FunctionDecl *, std::uint32_t>();
+        collectedElsewhere = FlatMap<const clang::FunctionDecl *, bool>();
+        strings = StringPool();
+        cacheFile = FlatMap<const clang::FileEntry *, FileInfo>();
+    }
+
+    std::uint64_t DataCollector::getCacheKey()
     {
-        const int fd = open(lock.c_str(), O_RDONLY);
-        const int s = flock(fd, LOCK_EX);
-        if (s == 0)
+        // with the registry, the records of a TU depend on the other TUs,
+        // and with a PCH or a module on headers which aren't in fileinfo
+        if (!cache || registry || CI.getASTContext().getExternalSource() || !sm.getFileEntryForID(sm.getMainFileID()))
         {
-            DB db;
-            for (auto && i : defToDecl)
+            return 0;
+        }
+
+        // the files are sorted since the order of fileinfo isn't stable
+        std::vector<std::pair<std::string, std::uint64_t>> files;
+        for (auto i = sm.fileinfo_begin(); i != sm.fileinfo_end(); ++i)
+        {
+            if (const llvm::MemoryBuffer * buffer = i->second->getRawBuffer())
             {
-                Info def = getInfo(i.first, true);
-                db.insertDefinition(def);
-                for (auto && j : i.second)
-                {
-                    Info decl = getInfo(j, true);
-                    db.insertDeclaration(decl, def);
-                }
-                pushVirtualInfo(db, i.first);
+                files.emplace_back(i->first->getName(), utils::hash64(buffer->getBufferStart(), buffer->getBufferSize()));
             }
+        }
+        std::sort(files.begin(), files.end());
 
-            if (!cg.empty())
+        // the module hash covers the language, target, header search and preprocessor options
+        std::string key = CI.getInvocation().getModuleHash();
+        for (auto && s : { root, utils::getEnv("MOCODA_INCLUDE"), utils::getEnv("MOCODA_EXCLUDE"), cg,
+                           std::string(useId ? "id" : ""), std::string(useHash ? "hash" : ""),
+                           std::string(collapse ? "collapse" : ""), std::string(external ? "external" : "") })
+        {
+            key.append(s).push_back('\0');
+        }
+        for (auto && file : files)
+        {
+            key.append(file.first).push_back('\0');
+            key.append(reinterpret_cast<const char *>(&file.second), sizeof(file.second));
+        }
+
+        const std::uint64_t hash = utils::hash64(key.data(), key.size());
+        return hash ? hash : 1;
+    }
+
+    void DataCollector::handleTranslationUnit(clang::TranslationUnitDecl * decl)
+    {
+        Stopwatch watch;
+        Records records;
+        const std::uint64_t key = getCacheKey();
+        if (key && cache.load(key, records))
+        {
+            // nothing has changed since the last time the TU has been collected
+            counters.collect = watch.lap();
+        }
+        else
+        {
+            if (!external && decl->getASTContext().getExternalSource())
             {
-                for (auto && i : callgraph_resolved)
+                // only the declarations of this TU and the ones it has
+                // used are walked: the others aren't deserialized
+                for (auto && d : decl->noload_decls())
                 {
-                    Info def1 = getInfo(std::get<0>(i), true);
-                    Info def2 = getInfo(std::get<1>(i), true);
-                    const auto lc = getLineColumn(std::get<2>(i));
-                    db.insertCallResolved(def1, def2, lc.first, lc.second, isVirtual(std::get<1>(i)));
-                }
-                
-                for (auto && i : callgraph_unresolved)
-                {
-                    Info def = getInfo(std::get<0>(i), true);
-                    Info dec = getInfo(std::get<1>(i), true);
-                    db.insertDeclaration(dec);
-                    const auto lc = getLineColumn(std::get<2>(i));
-                    db.insertCallUnresolved(def, dec, lc.first, lc.second, isVirtual(std::get<1>(i)));
+                    TraverseDecl(d);
                 }
             }
-            
-            for (auto && i : defToDecl)
+            else
+            {
+                TraverseDecl(decl);
+            }
+            counters.traverse = watch.lap();
+            collect(records);
+            release();
+            if (key)
             {
-                pushVirtualInfo(db, i.first);
+                cache.store(key, records);
             }
+            counters.collect = watch.lap();
+        }
 
+        if (!stats.empty())
+        {
+            if (const clang::FileEntry * entry = sm.getFileEntryForID(sm.getMainFileID()))
+            {
+                counters.tu = entry->getName();
+            }
+        }
+
+        if (async)
+        {
+            // nothing from clang is used by push so the code can be
+            // generated in the meantime
+            if (!registered)
+            {
+                // the handler is registered after the static objects used by
+                // push have been constructed, so it runs before they're destroyed
+                registered = std::atexit(joinRunning) == 0;
+            }
+            join();
+            running = this;
+            pending = std::move(records);
+            writer = std::thread([this]()
+                                 {
+                                     push(pending);
+                                 });
+        }
+        else
+        {
+            push(records);
+        }
+    }
+
+    void DataCollector::push(const Records & records)
+    {
+        Stopwatch watch;
+        std::string shard;
+        if (!socket.empty() && channel::send(socket, records))
+        {
+            // mocoda-collector has the records: if it isn't running then
+            // we fall back on the database
+            counters.write = watch.lap();
+        }
+        else if (!shards.empty() && !(shard = utils::getUniqueFile(shards, "shard-", ".sqlite")).empty())
+        {
+            // each TU writes its own shard so there is nothing to lock:
+            // the shards are merged with mocoda-merge once the build is done
+            DB db(shard, false);
+            records.write(db);
+            counters.write = watch.lap();
             db.commit();
+            counters.commit = watch.lap();
+        }
+        else
+        {
+            if (!shards.empty())
+            {
+                // as with the socket, we fall back on the database
+                std::cerr << "Can't create a shard: "
+                          << std::strerror(errno)
+                          << ": " << shards
+                          << std::endl;
+            }
 
-            flock(fd, LOCK_UN);
-            close(fd);
+            const std::string database = utils::getEnv("MOCODA_DATABASE");
+            const int fd = database.empty() ? -1 : open(lock.c_str(), O_RDONLY);
+            const int s = fd == -1 ? -1 : flock(fd, LOCK_EX);
+            counters.lock = watch.lap();
+            if (database.empty())
+            {
+                // the records would be lost without any notice
+                std::cerr << "Can't write the records: MOCODA_DATABASE isn't set" << std::endl;
+            }
+            else if (s == 0)
+            {
+                DB db(database);
+                records.write(db);
+                counters.write = watch.lap();
+                db.commit();
+                counters.commit = watch.lap();
+
+                flock(fd, LOCK_UN);
+                close(fd);
+            }
+            else
+            {
+                std::cerr << "Can't lock: " << lock << std::endl;
+                if (fd != -1)
+                {
+                    close(fd);
+                }
+            }
+        }
+
+        if (!stats.empty())
+        {
+            counters.definitions = records.definitions.size();
+            counters.declarations = records.declarations.size();
+            counters.calls = records.callsResolved.size() + records.callsUnresolved.size();
+            counters.overrides = records.overridesResolved.size() + records.overridesUnresolved.size();
+            counters.setMaxRSS();
+            counters.append(stats);
         }
     }
 
@@ -452,8 +976,7 @@ namespace mocoda
 
     void DataCollectorConsumer::HandleTranslationUnit(clang::ASTContext & ctxt)
     {
-        visitor.TraverseDecl(ctxt.getTranslationUnitDecl());
-        visitor.push();
+        visitor.handleTranslationUnit(ctxt.getTranslationUnitDecl());
     }
 
     std::unique_ptr<clang::ASTConsumer> DataCollectorAction::CreateASTConsumer(clang::CompilerInstance & CI, llvm::StringRef)
@@ -462,15 +985,16 @@ namespace mocoda
         return llvm::make_unique<DataCollectorConsumer>(CI);
     }
 
-    bool DataCollectorAction::ParseArgs(const clang::CompilerInstance & CI, const std::vector<std::string> & args)
+    bool DataCollectorAction::ParseArgs(const clang::CompilerInstance &, const std::vector<std::string> &)
     {
         return true;
     }
 
-    // Automatically run the plugin after the main AST action
+    // Automatically run the plugin after the main AST action, or before
+    // it when the records are written while the code is generated
     clang::PluginASTAction::ActionType DataCollectorAction::getActionType()
     {
-        return AddAfterMainAction;
+        return utils::getEnv("MOCODA_ASYNC").empty() ? AddAfterMainAction : AddBeforeMainAction;
     }
 }
 
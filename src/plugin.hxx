@@ -5,54 +5,139 @@
 #ifndef __PLUGIN_HXX__
 #define __PLUGIN_HXX__
 
+#include <cstdint>
+#include <memory>
 #include <ostream>
 #include <stack>
 #include <string>
-#include <unordered_map>
-#include <unordered_set>
+#include <thread>
 #include <vector>
 
 #include "clang/Frontend/FrontendPluginRegistry.h"
 #include "clang/AST/AST.h"
 #include "clang/AST/ASTConsumer.h"
+#include "clang/AST/Mangle.h"
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Frontend/CompilerInstance.h"
+#include "clang/Lex/Lexer.h"
 #include "clang/Sema/Sema.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include "cache.hxx"
+#include "counters.hxx"
+#include "flatmap.hxx"
 #include "info.hxx"
-#include "DB.hxx"
+#include "records.hxx"
+#include "registry.hxx"
+#include "strpool.hxx"
 
 namespace mocoda
 {
 
+    // Info with interned filename and function name (see StringPool):
+    // when the function has an id, funname is 0 until the name is rendered
+    struct InfoRef
+    {
+        std::uint32_t filename;
+        std::uint32_t funname;
+        std::uint32_t begin;
+        std::uint32_t end;
+        std::uint64_t id;
+
+        operator bool() const
+            {
+                return begin <= end;
+            }
+    };
+
     class DataCollector : public clang::RecursiveASTVisitor<DataCollector>
     {
         typedef clang::RecursiveASTVisitor<DataCollector> Super;
         typedef std::vector<const clang::FunctionDecl *> Declarations;
         typedef std::tuple<const clang::FunctionDecl *, const clang::FunctionDecl *, const clang::Expr *> Edge;
 
+        // the real path of a file and its path relative to the root
+        // (0 if the file is out of the root or excluded)
+        struct FileInfo
+        {
+            std::uint32_t path;
+            std::uint32_t rpath;
+        };
+
+        // a function with a body and the range of its declarations in DataCollector::declarations
+        struct Definition
+        {
+            const clang::FunctionDecl * decl;
+            std::uint32_t firstDecl;
+            std::uint32_t lastDecl;
+        };
+
         clang::CompilerInstance & CI;
         const clang::SourceManager & sm;
         const clang::PrintingPolicy & policy;
         const std::string root;
+        const std::vector<std::string> includes;
+        const std::vector<std::string> excludes;
         const std::string lock;
         const std::string cg;
+        const std::string shards;
+        const std::string socket;
+        const std::string stats;
+        const bool useId;
+        // record a hash of the tokens of the definitions
+        const bool useHash;
+        // write the records in a thread while clang generates the code
+        const bool async;
+        // an instantiation of a template is recorded as the template itself
+        const bool collapse;
+        // traverse the declarations deserialized from a PCH or a module
+        const bool external;
+        std::unique_ptr<clang::MangleContext> mangler;
         std::vector<Edge> callgraph_resolved;
         std::vector<Edge> callgraph_unresolved;
-        std::unordered_map<const clang::FunctionDecl *, Declarations> defToDecl;
-        std::unordered_set<const clang::FunctionDecl *> callDecl;
-        std::unordered_map<const clang::FunctionDecl *, Info> cacheInfo;
+        StringPool strings;
+        std::vector<Definition> definitions;
+        Declarations declarations;
+        FlatMap<const clang::FunctionDecl *, std::uint32_t> defToDecl;
+        FlatMap<const clang::FunctionDecl *, InfoRef> cacheInfo;
+        FlatMap<const clang::FileEntry *, FileInfo> cacheFile;
+        FlatMap<const clang::FunctionDecl *, std::uint32_t> defIds;
+        FlatMap<const clang::FunctionDecl *, std::uint32_t> declIds;
+        // the functions whose body has been collected in another TU
+        FlatMap<const clang::FunctionDecl *, bool> collectedElsewhere;
         std::stack<const clang::FunctionDecl *> stack;
+        Registry registry;
+        RecordsCache cache;
+        Counters counters;
+        // the records written by the writer thread
+        Records pending;
+        std::thread writer;
         
     public:
 
         DataCollector(clang::CompilerInstance & __CI);
-
-        std::tuple<std::string, std::size_t, std::size_t> getFileRange(const clang::FunctionDecl * decl, const bool checkSrc) const;
-        Info getInfo(const clang::FunctionDecl * decl, const bool checkSrc);
-        Info getVirtualInfo(const clang::FunctionDecl * decl, const bool checkSrc);
-        void pushVirtualInfo(DB & db, const clang::FunctionDecl * decl);
+        ~DataCollector();
+
+        // wait for the records of the TU to be written
+        void join();
+
+        FileInfo getFileInfo(const clang::FileEntry * entry);
+        bool isPruned(const clang::Decl * decl);
+        bool isExternal(const clang::Decl * decl) const;
+        std::tuple<std::uint32_t, std::size_t, std::size_t> getFileRange(const clang::FunctionDecl * decl, const bool checkSrc);
+        InfoRef getInfo(const clang::FunctionDecl * decl, const bool checkSrc);
+        InfoRef getNamedInfo(const clang::FunctionDecl * decl);
+        bool hasDependentParameter(const clang::FunctionDecl * decl);
+        std::string getName(const clang::FunctionDecl * decl);
+        std::uint64_t getId(const clang::FunctionDecl * decl, const std::uint32_t file);
+        std::uint64_t getBodyHash(const clang::FunctionDecl * decl);
+        void pushBodyHash(Records & records, const clang::FunctionDecl * decl, const std::uint32_t def);
+        InfoRef getVirtualInfo(const clang::FunctionDecl * decl, const bool checkSrc);
+        const clang::FunctionDecl * getNode(const clang::FunctionDecl * decl);
+        Info toInfo(const InfoRef & info) const;
+        void pushVirtualInfo(Records & records, const clang::FunctionDecl * decl);
+        std::uint32_t getDefinitionIndex(Records & records, const clang::FunctionDecl * decl);
+        std::uint32_t getDeclarationIndex(Records & records, const clang::FunctionDecl * decl, const std::uint32_t def = Records::NONE);
         std::pair<std::size_t, std::size_t> getLineColumn(const clang::Expr * expr);
         bool isVirtual(const clang::FunctionDecl * decl);
         void handleFunctionTemplateDecl(clang::FunctionTemplateDecl * decl);
@@ -63,6 +148,7 @@ namespace mocoda
         void handleFunctionDecl(const clang::FunctionDecl * decl);
         void handleDecl(clang::Decl * decl);
         bool VisitClassTemplateDecl(clang::ClassTemplateDecl * decl);
+        bool TraverseDecl(clang::Decl * decl);
         bool TraverseFunctionDecl(clang::FunctionDecl * decl);
         bool TraverseCXXMethodDecl(clang::CXXMethodDecl * decl);
         bool TraverseCXXConstructorDecl(clang::CXXConstructorDecl * decl);
@@ -74,7 +160,11 @@ namespace mocoda
         bool handleCall(clang::Expr *, clang::Decl * d);
         bool isContainedInAClassTemplate(clang::FunctionDecl * decl);
         bool isContainedInAClassTemplate(clang::FunctionTemplateDecl * decl);
-        void push();
+        void collect(Records & records);
+        void release();
+        std::uint64_t getCacheKey();
+        void handleTranslationUnit(clang::TranslationUnitDecl * decl);
+        void push(const Records & records);
 
     };
 
@@ -100,7 +190,8 @@ namespace mocoda
         std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(clang::CompilerInstance &CI, llvm::StringRef) override;
         bool ParseArgs(const clang::CompilerInstance & CI, const std::vector<std::string> & args) override;
 
-        // Automatically run the plugin after the main AST action
+        // Automatically run the plugin after the main AST action, or before
+        // it when the records are written while the code is generated
         PluginASTAction::ActionType getActionType() override;
     };
 
@@ -0,0 +1,147 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+// mocoda-query: query a call graph, either a file written by mocoda-pack
+// or a database which is then loaded in memory.
+//
+// Usage: mocoda-query [-d DEPTH] [-v] GRAPH [callers PATTERN | callees PATTERN | path FROM TO]
+//
+//   -d: maximal depth of the traversal (0 for no limit)
+//   -v: a virtual call can be dispatched to all the methods overriding the callee
+//
+// The patterns are function names or shell wildcard patterns. Without a
+// command, the queries are read from the standard input, one per line and
+// with tab-separated fields, and each result is followed by an empty line.
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "graphbuilder.hxx"
+#include "traversal.hxx"
+
+namespace mocoda
+{
+    class QueryRunner
+    {
+        const CallGraph & graph;
+        Traversal traversal;
+        const std::uint32_t depth;
+        const bool virtuals;
+
+    public:
+
+        QueryRunner(const CallGraph & __graph, const std::uint32_t __depth, const bool __virtuals) : graph(__graph), traversal(__graph), depth(__depth), virtuals(__virtuals) { }
+
+        bool run(const std::vector<std::string> & query, std::ostream & out);
+
+    private:
+
+        void print(std::ostream & out, const std::uint32_t i) const;
+    };
+
+    void QueryRunner::print(std::ostream & out, const std::uint32_t i) const
+    {
+        const format::Definition & d = graph.def(i);
+        out << graph.name(i) << '\t' << graph.filename(i) << ':' << d.begin << '-' << d.end << '\n';
+    }
+
+    bool QueryRunner::run(const std::vector<std::string> & query, std::ostream & out)
+    {
+        if (query.size() == 2 && (query[0] == "callers" || query[0] == "callees"))
+        {
+            const Traversal::Direction direction = query[0] == "callers" ? Traversal::CALLERS : Traversal::CALLEES;
+            for (auto && d : traversal.reach(traversal.match(query[1]), direction, depth, virtuals))
+            {
+                out << d.second << '\t';
+                print(out, d.first);
+            }
+            return true;
+        }
+
+        if (query.size() == 3 && query[0] == "path")
+        {
+            for (auto && i : traversal.path(traversal.match(query[1]), traversal.match(query[2]), depth, virtuals))
+            {
+                print(out, i);
+            }
+            return true;
+        }
+
+        std::cerr << "Invalid query:";
+        for (auto && s : query)
+        {
+            std::cerr << ' ' << s;
+        }
+        std::cerr << std::endl;
+        return false;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    std::uint32_t depth = 0;
+    bool virtuals = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:v")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd': depth = std::strtoul(optarg, nullptr, 10); break;
+        case 'v': virtuals = true; break;
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-d DEPTH] [-v] GRAPH [callers PATTERN | callees PATTERN | path FROM TO]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        std::cerr << "Usage: " << argv[0] << " [-d DEPTH] [-v] GRAPH [callers PATTERN | callees PATTERN | path FROM TO]" << std::endl;
+        return 1;
+    }
+
+    mocoda::CallGraph graph;
+    std::vector<char> image;
+    if (!mocoda::GraphBuilder::open(argv[optind], graph, image))
+    {
+        return 1;
+    }
+
+    mocoda::QueryRunner runner(graph, depth, virtuals);
+    if (optind + 1 < argc)
+    {
+        return runner.run(std::vector<std::string>(argv + optind + 1, argv + argc), std::cout) ? 0 : 1;
+    }
+
+    int ret = 0;
+    std::string line;
+    while (std::getline(std::cin, line))
+    {
+        if (line.empty())
+        {
+            continue;
+        }
+
+        std::vector<std::string> query;
+        std::istringstream in(line);
+        std::string field;
+        while (std::getline(in, field, '\t'))
+        {
+            query.push_back(field);
+        }
+
+        if (!runner.run(query, std::cout))
+        {
+            ret = 1;
+        }
+        std::cout << '\n';
+    }
+
+    return ret;
+}
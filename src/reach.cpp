@@ -0,0 +1,181 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+// mocoda-reach: build and query the reachability index of a call graph
+// (see reachability.hxx), either a file written by mocoda-pack or a database.
+//
+// Usage: mocoda-reach build GRAPH INDEX
+//        mocoda-reach query GRAPH INDEX
+//
+// build does nothing when INDEX has been built from a graph with the same
+// calls: the positions of the definitions aren't used by the index, so an
+// edit which moves the code without adding or removing calls keeps it.
+// Otherwise INDEX is updated: only the components of the definitions whose
+// callees have changed, and of their callers, are computed again. It's
+// rebuilt from scratch when most of the definitions would be.
+// query reads lines with two tab-separated patterns FROM and TO (function
+// names or shell wildcard patterns) and writes the pairs of matching
+// definitions such that FROM reaches TO, followed by an empty line.
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <cstdio>
+
+#include "graphbuilder.hxx"
+#include "reachability.hxx"
+#include "traversal.hxx"
+#include "utils.hxx"
+
+namespace mocoda
+{
+    // hash of what the index depends on: the definitions and their callees
+    std::uint64_t getCallsHash(const CallGraph & graph)
+    {
+        const std::uint32_t n = graph.defCount();
+        std::uint64_t hash = utils::hash64(&n, sizeof(n));
+        for (std::uint32_t i = 0; i < n; ++i)
+        {
+            const Range<format::Edge> callees = graph.callees(i);
+            const std::uint32_t count = callees.size();
+            hash = utils::hash64(&count, sizeof(count), hash);
+            for (auto && e : callees)
+            {
+                hash = utils::hash64(&e.target, sizeof(e.target), hash);
+            }
+        }
+        return hash;
+    }
+
+    // a definition is identified by its file and its name, and its
+    // calls by the keys of its callees (see ReachabilityIndex::update)
+    std::vector<format::Signature> getSignatures(const CallGraph & graph)
+    {
+        const std::uint32_t n = graph.defCount();
+        std::vector<format::Signature> signatures(n);
+        for (std::uint32_t i = 0; i < n; ++i)
+        {
+            const char * file = graph.filename(i);
+            const char * name = graph.name(i);
+            signatures[i].key = utils::hash64(name, std::strlen(name) + 1, utils::hash64(file, std::strlen(file) + 1));
+        }
+
+        std::vector<std::uint64_t> keys;
+        for (std::uint32_t i = 0; i < n; ++i)
+        {
+            keys.clear();
+            for (auto && e : graph.callees(i))
+            {
+                keys.push_back(signatures[e.target].key);
+            }
+            std::sort(keys.begin(), keys.end());
+            keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+            const std::uint32_t count = keys.size();
+            signatures[i].calls = utils::hash64(keys.data(), keys.size() * sizeof(std::uint64_t), utils::hash64(&count, sizeof(count)));
+        }
+
+        return signatures;
+    }
+
+    bool build(const CallGraph & graph, const std::string & path)
+    {
+        const std::uint64_t hash = getCallsHash(graph);
+        const std::vector<format::Signature> signatures = getSignatures(graph);
+        std::vector<char> image;
+        {
+            ReachabilityIndex index;
+            if (utils::exist(path) && index.open(path))
+            {
+                if (index.graphHash() == hash)
+                {
+                    // the calls haven't changed
+                    return true;
+                }
+                image = ReachabilityIndex::update(index, graph, signatures, hash);
+            }
+        }
+
+        if (image.empty())
+        {
+            image = ReachabilityIndex::build(graph, signatures, hash);
+        }
+        const std::string tmp = path + ".tmp";
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(image.data(), image.size());
+        out.close();
+        if (!out || std::rename(tmp.c_str(), path.c_str()) != 0)
+        {
+            std::cerr << "Can't write reachability index: " << path << std::endl;
+            std::remove(tmp.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    bool query(const CallGraph & graph, const std::string & path)
+    {
+        ReachabilityIndex index;
+        if (!index.open(path))
+        {
+            return false;
+        }
+        if (index.graphHash() != getCallsHash(graph))
+        {
+            std::cerr << "The reachability index hasn't been built from this graph: " << path << std::endl;
+            return false;
+        }
+
+        Traversal traversal(graph);
+        std::string line;
+        while (std::getline(std::cin, line))
+        {
+            const std::size_t pos = line.find('\t');
+            if (pos == std::string::npos)
+            {
+                continue;
+            }
+
+            const std::vector<std::uint32_t> from = traversal.match(line.substr(0, pos));
+            const std::vector<std::uint32_t> to = traversal.match(line.substr(pos + 1));
+            for (auto && f : from)
+            {
+                for (auto && t : to)
+                {
+                    if (index.reaches(f, t))
+                    {
+                        std::cout << graph.name(f) << '\t' << graph.name(t) << '\n';
+                    }
+                }
+            }
+            std::cout << '\n';
+        }
+
+        return true;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc != 4 || (std::string(argv[1]) != "build" && std::string(argv[1]) != "query"))
+    {
+        std::cerr << "Usage: " << argv[0] << " build|query GRAPH INDEX" << std::endl;
+        return 1;
+    }
+
+    mocoda::CallGraph graph;
+    std::vector<char> image;
+    if (!mocoda::GraphBuilder::open(argv[2], graph, image))
+    {
+        return 1;
+    }
+
+    const bool ok = std::string(argv[1]) == "build" ? mocoda::build(graph, argv[3]) : mocoda::query(graph, argv[3]);
+    return ok ? 0 : 1;
+}
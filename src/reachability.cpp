@@ -0,0 +1,461 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "reachability.hxx"
+
+namespace mocoda
+{
+    namespace
+    {
+        const std::uint32_t NONE = std::uint32_t(-1);
+
+        template<typename T>
+        std::uint64_t append(std::vector<char> & image, const std::vector<T> & data)
+        {
+            image.resize((image.size() + 7) & ~std::size_t(7), 0);
+            const std::uint64_t offset = image.size();
+            const char * p = reinterpret_cast<const char *>(data.data());
+            image.insert(image.end(), p, p + data.size() * sizeof(T));
+            return offset;
+        }
+
+        // iterative Tarjan on the definitions without a component (sccs[v] is NONE):
+        // the components are numbered from base in the order they're completed
+        // and first[c - base] is the first component completed in the DFS subtree
+        // of the root of c, so [first[c - base], c] are reachable from c
+        std::uint32_t tarjan(const CallGraph & graph, std::vector<std::uint32_t> & sccs, std::vector<std::uint32_t> & first, const std::uint32_t base)
+        {
+            const std::uint32_t n = graph.defCount();
+            std::vector<std::uint32_t> index(n, NONE), low(n), start(n);
+            std::vector<bool> onStack(n, false);
+            std::vector<std::uint32_t> stack;
+            std::vector<std::pair<std::uint32_t, std::uint32_t>> frames;
+            std::uint32_t counter = 0;
+            std::uint32_t count = base;
+
+            first.clear();
+
+            auto visit = [&](const std::uint32_t v)
+                {
+                    index[v] = low[v] = counter++;
+                    start[v] = count;
+                    stack.push_back(v);
+                    onStack[v] = true;
+                    frames.emplace_back(v, 0);
+                };
+
+            for (std::uint32_t root = 0; root < n; ++root)
+            {
+                if (index[root] != NONE || sccs[root] != NONE)
+                {
+                    continue;
+                }
+
+                visit(root);
+                while (!frames.empty())
+                {
+                    const std::uint32_t v = frames.back().first;
+                    const Range<format::Edge> edges = graph.callees(v);
+                    if (frames.back().second < edges.size())
+                    {
+                        const std::uint32_t w = edges[frames.back().second++].target;
+                        if (index[w] == NONE && sccs[w] == NONE)
+                        {
+                            visit(w);
+                        }
+                        else if (onStack[w])
+                        {
+                            low[v] = std::min(low[v], index[w]);
+                        }
+                        continue;
+                    }
+
+                    frames.pop_back();
+                    if (!frames.empty())
+                    {
+                        const std::uint32_t u = frames.back().first;
+                        low[u] = std::min(low[u], low[v]);
+                    }
+
+                    if (low[v] == index[v])
+                    {
+                        std::uint32_t w;
+                        do
+                        {
+                            w = stack.back();
+                            stack.pop_back();
+                            onStack[w] = false;
+                            sccs[w] = count;
+                        }
+                        while (w != v);
+                        first.push_back(start[v]);
+                        ++count;
+                    }
+                }
+            }
+
+            return count;
+        }
+
+        void merge(std::vector<format::Interval> & intervals)
+        {
+            std::sort(intervals.begin(), intervals.end(), [](const format::Interval & a, const format::Interval & b)
+                      {
+                          return a.lo < b.lo;
+                      });
+
+            std::size_t last = 0;
+            for (std::size_t i = 1; i < intervals.size(); ++i)
+            {
+                if (intervals[i].lo <= std::uint64_t(intervals[last].hi) + 1)
+                {
+                    intervals[last].hi = std::max(intervals[last].hi, intervals[i].hi);
+                }
+                else
+                {
+                    intervals[++last] = intervals[i];
+                }
+            }
+            intervals.resize(intervals.empty() ? 0 : last + 1);
+        }
+
+        // append the labels of the components [base, count) to the ones of the
+        // components before them
+        void label(const CallGraph & graph, const std::vector<std::uint32_t> & sccs, const std::vector<std::uint32_t> & first,
+                   const std::uint32_t base, const std::uint32_t count,
+                   std::vector<std::uint64_t> & labelsIndex, std::vector<format::Interval> & labels)
+        {
+            // the members of each component
+            std::vector<std::uint32_t> membersIndex(count - base + 1, 0), members;
+            for (auto && c : sccs)
+            {
+                if (c >= base)
+                {
+                    ++membersIndex[c - base + 1];
+                }
+            }
+            for (std::uint32_t c = 0; c < count - base; ++c)
+            {
+                membersIndex[c + 1] += membersIndex[c];
+            }
+            members.resize(membersIndex.back());
+            std::vector<std::uint32_t> pos(membersIndex.begin(), membersIndex.end() - 1);
+            for (std::uint32_t v = 0; v < sccs.size(); ++v)
+            {
+                if (sccs[v] >= base)
+                {
+                    members[pos[sccs[v] - base]++] = v;
+                }
+            }
+
+            // the successors of a component have been completed before it,
+            // so their labels are known when its label is computed
+            std::vector<format::Interval> label;
+            std::vector<std::uint32_t> seen(count, NONE);
+            labelsIndex.reserve(count + 1);
+            for (std::uint32_t c = base; c < count; ++c)
+            {
+                label.assign(1, { first[c - base], c });
+                for (std::uint32_t m = membersIndex[c - base]; m < membersIndex[c - base + 1]; ++m)
+                {
+                    for (auto && e : graph.callees(members[m]))
+                    {
+                        const std::uint32_t d = sccs[e.target];
+                        if (d != c && seen[d] != c)
+                        {
+                            seen[d] = c;
+                            label.insert(label.end(), labels.begin() + labelsIndex[d], labels.begin() + labelsIndex[d + 1]);
+                        }
+                    }
+                }
+                merge(label);
+                labels.insert(labels.end(), label.begin(), label.end());
+                labelsIndex.push_back(labels.size());
+            }
+        }
+
+        // everything read later is checked once here, so a corrupt or
+        // truncated index is rejected instead of being read out of bounds
+        bool check(const char * buffer, const format::ReachHeader * h)
+        {
+            using namespace format;
+            const std::uint64_t size = h->size;
+            const std::uint32_t * sccs = extent<std::uint32_t>(buffer, size, h->sccs, h->defCount);
+            const std::uint64_t * labelsIndex = extent<std::uint64_t>(buffer, size, h->labelsIndex, std::uint64_t(h->sccCount) + 1);
+            const Interval * labels = extent<Interval>(buffer, size, h->labels, h->intervalCount);
+            if (!sccs || !labelsIndex || !labels || !extent<Signature>(buffer, size, h->signatures, h->defCount)
+                || !below(sccs, h->defCount, h->sccCount)
+                || !isIndex(labelsIndex, h->sccCount, h->intervalCount))
+            {
+                return false;
+            }
+
+            // the intervals of a label are sorted and disjoint, which reaches() relies on
+            for (std::uint32_t c = 0; c < h->sccCount; ++c)
+            {
+                for (std::uint64_t i = labelsIndex[c]; i < labelsIndex[c + 1]; ++i)
+                {
+                    if (labels[i].lo > labels[i].hi || labels[i].hi >= h->sccCount
+                        || (i > labelsIndex[c] && labels[i - 1].hi >= labels[i].lo))
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        std::vector<char> write(const std::vector<std::uint32_t> & sccs, const std::uint32_t count,
+                                const std::vector<std::uint64_t> & labelsIndex, const std::vector<format::Interval> & labels,
+                                const std::vector<format::Signature> & signatures, const std::uint64_t graphHash)
+        {
+            format::ReachHeader header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, format::REACH_MAGIC, sizeof(format::REACH_MAGIC));
+            header.version = format::REACH_VERSION;
+            header.defCount = sccs.size();
+            header.sccCount = count;
+            header.intervalCount = labels.size();
+            header.graphHash = graphHash;
+
+            std::vector<char> image(sizeof(header), 0);
+            header.sccs = append(image, sccs);
+            header.labelsIndex = append(image, labelsIndex);
+            header.labels = append(image, labels);
+            header.signatures = append(image, signatures);
+            image.resize((image.size() + 7) & ~std::size_t(7), 0);
+            header.size = image.size();
+            std::memcpy(image.data(), &header, sizeof(header));
+
+            return image;
+        }
+    }
+
+    ReachabilityIndex::ReachabilityIndex() : map(nullptr), mapSize(0), data(nullptr), header(nullptr) { }
+
+    ReachabilityIndex::~ReachabilityIndex()
+    {
+        close();
+    }
+
+    std::vector<char> ReachabilityIndex::build(const CallGraph & graph, const std::vector<format::Signature> & signatures, const std::uint64_t graphHash)
+    {
+        std::vector<std::uint32_t> sccs(graph.defCount(), NONE), first;
+        const std::uint32_t count = tarjan(graph, sccs, first, 0);
+
+        std::vector<std::uint64_t> labelsIndex(1, 0);
+        std::vector<format::Interval> labels;
+        label(graph, sccs, first, 0, count, labelsIndex, labels);
+
+        return write(sccs, count, labelsIndex, labels, signatures, graphHash);
+    }
+
+    std::vector<char> ReachabilityIndex::update(const ReachabilityIndex & old, const CallGraph & graph,
+                                                const std::vector<format::Signature> & signatures, const std::uint64_t graphHash)
+    {
+        const std::uint32_t n = graph.defCount();
+        const format::Signature * oldSignatures = old.section<format::Signature>(old.header->signatures);
+
+        // the old definitions by key (NONE when several definitions have the same key)
+        std::unordered_map<std::uint64_t, std::uint32_t> byKey;
+        for (std::uint32_t u = 0; u < old.defCount(); ++u)
+        {
+            auto r = byKey.emplace(oldSignatures[u].key, u);
+            if (!r.second)
+            {
+                r.first->second = NONE;
+            }
+        }
+        std::unordered_map<std::uint64_t, std::uint32_t> keys;
+        for (auto && s : signatures)
+        {
+            ++keys[s.key];
+        }
+
+        // a definition has changed when it's new, when its callees have
+        // changed or when it can't be told apart from another one
+        std::vector<std::uint32_t> previous(n, NONE);
+        std::vector<bool> dirty(n, false);
+        std::vector<std::uint32_t> todo;
+        for (std::uint32_t v = 0; v < n; ++v)
+        {
+            auto i = byKey.find(signatures[v].key);
+            if (i != byKey.end() && i->second != NONE && keys[signatures[v].key] == 1
+                && oldSignatures[i->second].calls == signatures[v].calls)
+            {
+                previous[v] = i->second;
+            }
+            else
+            {
+                dirty[v] = true;
+                todo.push_back(v);
+            }
+        }
+
+        // and so are the definitions which reach it: the other ones reach
+        // the same definitions as before
+        std::uint32_t dirtyCount = todo.size();
+        while (!todo.empty())
+        {
+            const std::uint32_t v = todo.back();
+            todo.pop_back();
+            for (auto && e : graph.callers(v))
+            {
+                if (!dirty[e.target])
+                {
+                    dirty[e.target] = true;
+                    todo.push_back(e.target);
+                    ++dirtyCount;
+                }
+            }
+        }
+
+        if (std::uint64_t(dirtyCount) * 2 > n)
+        {
+            return std::vector<char>();
+        }
+
+        // the clean definitions keep their components, and a component is
+        // either entirely clean or entirely dirty
+        const std::uint32_t base = old.sccCount();
+        std::vector<std::uint32_t> sccs(n, NONE), first;
+        std::vector<bool> kept(base, false);
+        std::uint32_t keptCount = 0;
+        for (std::uint32_t v = 0; v < n; ++v)
+        {
+            if (!dirty[v])
+            {
+                sccs[v] = old.scc(previous[v]);
+                if (!kept[sccs[v]])
+                {
+                    kept[sccs[v]] = true;
+                    ++keptCount;
+                }
+            }
+        }
+
+        const std::uint32_t count = tarjan(graph, sccs, first, base);
+        if (base - keptCount > keptCount + (count - base))
+        {
+            // most of the numbers would be unused
+            return std::vector<char>();
+        }
+
+        // the labels of the clean components only have clean components
+        std::vector<std::uint64_t> labelsIndex(1, 0);
+        std::vector<format::Interval> labels;
+        const std::uint64_t * oldIndex = old.section<std::uint64_t>(old.header->labelsIndex);
+        const format::Interval * oldLabels = old.section<format::Interval>(old.header->labels);
+        for (std::uint32_t c = 0; c < base; ++c)
+        {
+            if (kept[c])
+            {
+                labels.insert(labels.end(), oldLabels + oldIndex[c], oldLabels + oldIndex[c + 1]);
+            }
+            labelsIndex.push_back(labels.size());
+        }
+        label(graph, sccs, first, base, count, labelsIndex, labels);
+
+        return write(sccs, count, labelsIndex, labels, signatures, graphHash);
+    }
+
+    bool ReachabilityIndex::open(const std::string & path)
+    {
+        close();
+
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+        {
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void * m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (m != MAP_FAILED)
+            {
+                map = m;
+                mapSize = st.st_size;
+            }
+        }
+        ::close(fd);
+
+        if (!map || !load(static_cast<const char *>(map), mapSize))
+        {
+            std::cerr << "Invalid reachability index: " << path << std::endl;
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    bool ReachabilityIndex::load(const char * buffer, const std::size_t size)
+    {
+        if (size < sizeof(format::ReachHeader))
+        {
+            return false;
+        }
+
+        const format::ReachHeader * h = reinterpret_cast<const format::ReachHeader *>(buffer);
+        if (std::memcmp(h->magic, format::REACH_MAGIC, sizeof(format::REACH_MAGIC)) != 0
+            || h->version != format::REACH_VERSION
+            || h->size > size
+            || !check(buffer, h))
+        {
+            return false;
+        }
+
+        data = buffer;
+        header = h;
+
+        return true;
+    }
+
+    void ReachabilityIndex::close()
+    {
+        if (map)
+        {
+            munmap(map, mapSize);
+            map = nullptr;
+            mapSize = 0;
+        }
+        data = nullptr;
+        header = nullptr;
+    }
+
+    std::uint32_t ReachabilityIndex::scc(const std::uint32_t def) const
+    {
+        return section<std::uint32_t>(header->sccs)[def];
+    }
+
+    bool ReachabilityIndex::reaches(const std::uint32_t from, const std::uint32_t to) const
+    {
+        const std::uint32_t c = scc(from);
+        const std::uint32_t d = scc(to);
+        const std::uint64_t * index = section<std::uint64_t>(header->labelsIndex);
+        const format::Interval * first = section<format::Interval>(header->labels) + index[c];
+        const format::Interval * last = section<format::Interval>(header->labels) + index[c + 1];
+
+        // the first interval ending after d is the only one which can contain it
+        const format::Interval * i = std::lower_bound(first, last, d, [](const format::Interval & x, const std::uint32_t y)
+                                                      {
+                                                          return x.hi < y;
+                                                      });
+        return i != last && i->lo <= d;
+    }
+}
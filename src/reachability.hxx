@@ -0,0 +1,112 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __REACHABILITY_HXX__
+#define __REACHABILITY_HXX__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "callgraph.hxx"
+
+namespace mocoda
+{
+    // Layout of the reachability index written by mocoda-reach.
+    // The strongly connected components of the call graph are numbered in
+    // the order Tarjan's algorithm completes them, which is a post-order of
+    // the condensed DAG: the components reachable from a component are the
+    // union of a few intervals of numbers (Agrawal et al. interval labels).
+    // When the index is updated, the components which haven't changed keep
+    // their numbers and the new ones are numbered after them: the numbers of
+    // the components which have disappeared are unused.
+    namespace format
+    {
+        const char REACH_MAGIC[8] = { 'M', 'O', 'C', 'O', 'D', 'A', 'R', 'I' };
+        const std::uint32_t REACH_VERSION = 3;
+
+        struct ReachHeader
+        {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t defCount;
+            std::uint32_t sccCount;
+            std::uint32_t reserved;
+            std::uint64_t intervalCount;
+            // hash of the calls of the graph the index has been built from
+            // (see mocoda-reach)
+            std::uint64_t graphHash;
+            std::uint64_t size;
+            // offsets of the sections from the beginning of the file
+            std::uint64_t sccs;             // defCount components
+            std::uint64_t labelsIndex;      // sccCount + 1 indices in labels
+            std::uint64_t labels;           // intervalCount Interval sorted and disjoint
+            std::uint64_t signatures;       // defCount Signature
+        };
+
+        struct Interval
+        {
+            std::uint32_t lo;
+            std::uint32_t hi;
+        };
+
+        // what identifies a definition from a graph to the next one:
+        // a hash of its file and its name, and a hash of the keys of its callees
+        struct Signature
+        {
+            std::uint64_t key;
+            std::uint64_t calls;
+        };
+    }
+
+    class ReachabilityIndex
+    {
+        void * map;
+        std::size_t mapSize;
+        const char * data;
+        const format::ReachHeader * header;
+
+    public:
+
+        ReachabilityIndex();
+        ~ReachabilityIndex();
+
+        ReachabilityIndex(const ReachabilityIndex &) = delete;
+        ReachabilityIndex & operator=(const ReachabilityIndex &) = delete;
+
+        static std::vector<char> build(const CallGraph & graph, const std::vector<format::Signature> & signatures, const std::uint64_t graphHash);
+        // the definitions whose calls are the same as in the old index, directly
+        // or not, keep their components: the other ones are labeled again.
+        // Return an empty image when it's cheaper to build the index from scratch.
+        static std::vector<char> update(const ReachabilityIndex & old, const CallGraph & graph,
+                                        const std::vector<format::Signature> & signatures, const std::uint64_t graphHash);
+
+        bool open(const std::string & path);
+        bool load(const char * buffer, const std::size_t size);
+        void close();
+
+        operator bool() const
+            {
+                return header != nullptr;
+            }
+
+        std::uint64_t graphHash() const { return header->graphHash; }
+        std::uint32_t defCount() const { return header->defCount; }
+        std::uint32_t sccCount() const { return header->sccCount; }
+        std::uint32_t scc(const std::uint32_t def) const;
+        // true if there is a chain of calls from a definition to another
+        bool reaches(const std::uint32_t from, const std::uint32_t to) const;
+
+    private:
+
+        template<typename T>
+        const T * section(const std::uint64_t offset) const
+            {
+                return reinterpret_cast<const T *>(data + offset);
+            }
+    };
+}
+
+#endif // __REACHABILITY_HXX__
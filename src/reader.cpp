@@ -0,0 +1,65 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+
+#include "reader.hxx"
+
+namespace mocoda
+{
+    Reader::Reader(const std::string & path) : db(nullptr)
+    {
+        if (sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
+        {
+            std::cerr << "Can't open database: "
+                      << sqlite3_errmsg(db)
+                      << ": " << path
+                      << std::endl;
+            sqlite3_close(db);
+            db = nullptr;
+        }
+    }
+
+    Reader::~Reader()
+    {
+        if (db)
+        {
+            sqlite3_close(db);
+        }
+    }
+
+    bool Reader::forEach(const char * sql, const std::function<void(sqlite3_stmt *)> & fun)
+    {
+        sqlite3_stmt * stmt = nullptr;
+        if (!db || sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+        {
+            if (db)
+            {
+                std::cerr << "SQL error: "
+                          << sqlite3_errmsg(db)
+                          << std::endl;
+            }
+            return false;
+        }
+
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            fun(stmt);
+        }
+        sqlite3_finalize(stmt);
+
+        return true;
+    }
+
+    Info Reader::getInfo(sqlite3_stmt * stmt, const int col)
+    {
+        const char * filename = reinterpret_cast<const char *>(sqlite3_column_text(stmt, col));
+        const char * funname = reinterpret_cast<const char *>(sqlite3_column_text(stmt, col + 1));
+        return Info(filename ? filename : "",
+                    funname ? funname : "",
+                    sqlite3_column_int64(stmt, col + 2),
+                    sqlite3_column_int64(stmt, col + 3),
+                    sqlite3_column_int64(stmt, col + 4));
+    }
+}
@@ -0,0 +1,39 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __READER_HXX__
+#define __READER_HXX__
+
+#include <functional>
+#include <sqlite3.h>
+#include <string>
+
+#include "info.hxx"
+
+namespace mocoda
+{
+    // Read-only access to a database (or a shard) written by DB
+    class Reader
+    {
+        sqlite3 * db;
+
+    public:
+
+        Reader(const std::string & path);
+        ~Reader();
+
+        operator bool() const
+            {
+                return db != nullptr;
+            }
+
+        bool forEach(const char * sql, const std::function<void(sqlite3_stmt *)> & fun);
+
+        // get the Info stored in the columns file name, function name, BEGIN, END, ID starting at col
+        // (the names are in the files and names tables)
+        static Info getInfo(sqlite3_stmt * stmt, const int col);
+    };
+}
+
+#endif // __READER_HXX__
@@ -0,0 +1,307 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "records.hxx"
+
+namespace mocoda
+{
+    const std::uint32_t Records::NONE;
+
+    namespace
+    {
+        // integers are written as LEB128 varints and strings are prefixed by their length
+        class Encoder
+        {
+            std::string & out;
+
+        public:
+
+            Encoder(std::string & __out) : out(__out) { }
+
+            void put(std::uint64_t x)
+            {
+                while (x >= 0x80)
+                {
+                    out.push_back(char((x & 0x7f) | 0x80));
+                    x >>= 7;
+                }
+                out.push_back(char(x));
+            }
+
+            void put(const std::string & s)
+            {
+                put(s.size());
+                out.append(s);
+            }
+
+            void put(const Info & i)
+            {
+                put(i.filename);
+                put(i.funname);
+                put(i.begin);
+                put(i.end);
+                put(i.id);
+            }
+
+            // NONE is written as 0 and an index as index + 1
+            void putIndex(const std::uint32_t i)
+            {
+                put(i == Records::NONE ? 0 : std::uint64_t(i) + 1);
+            }
+
+            void put(const Records::Declaration & d)
+            {
+                put(d.info);
+                putIndex(d.def);
+            }
+
+            void put(const Records::Call & c)
+            {
+                putIndex(c.caller);
+                putIndex(c.callee);
+                put(c.line);
+                put(c.col);
+                put(c.isvirtual);
+            }
+
+            void put(const Records::Override & o)
+            {
+                putIndex(o.def);
+                putIndex(o.vdef);
+            }
+
+            void put(const Records::Template & t)
+            {
+                putIndex(t.def);
+                put(t.count);
+                put(t.sample);
+            }
+
+            void put(const Records::Body & b)
+            {
+                putIndex(b.def);
+                put(b.hash);
+            }
+
+            template<typename T>
+            void put(const std::vector<T> & v)
+            {
+                put(v.size());
+                for (auto && x : v)
+                {
+                    put(x);
+                }
+            }
+        };
+
+        class Decoder
+        {
+            const char * data;
+            const char * end;
+            bool ok;
+
+        public:
+
+            Decoder(const char * __data, const std::size_t size) : data(__data), end(__data + size), ok(true) { }
+
+            operator bool() const
+                {
+                    return ok;
+                }
+
+            bool atEnd() const
+                {
+                    return data == end;
+                }
+
+            std::uint64_t get()
+            {
+                std::uint64_t x = 0;
+                for (unsigned shift = 0; shift < 64; shift += 7)
+                {
+                    if (data == end)
+                    {
+                        ok = false;
+                        return 0;
+                    }
+                    const unsigned char c = *data++;
+                    x |= std::uint64_t(c & 0x7f) << shift;
+                    if (!(c & 0x80))
+                    {
+                        return x;
+                    }
+                }
+                ok = false;
+                return 0;
+            }
+
+            std::uint32_t getIndex()
+            {
+                const std::uint64_t i = get();
+                return i == 0 ? Records::NONE : std::uint32_t(i - 1);
+            }
+
+            void get(std::string & s)
+            {
+                const std::uint64_t n = get();
+                if (!ok || n > std::uint64_t(end - data))
+                {
+                    ok = false;
+                    return;
+                }
+                s.assign(data, n);
+                data += n;
+            }
+
+            void get(Info & i)
+            {
+                get(i.filename);
+                get(i.funname);
+                i.begin = get();
+                i.end = get();
+                i.id = get();
+            }
+
+            void get(Records::Declaration & d)
+            {
+                get(d.info);
+                d.def = getIndex();
+            }
+
+            void get(Records::Call & c)
+            {
+                c.caller = getIndex();
+                c.callee = getIndex();
+                c.line = get();
+                c.col = get();
+                c.isvirtual = get();
+            }
+
+            void get(Records::Override & o)
+            {
+                o.def = getIndex();
+                o.vdef = getIndex();
+            }
+
+            void get(Records::Template & t)
+            {
+                t.def = getIndex();
+                t.count = get();
+                get(t.sample);
+            }
+
+            void get(Records::Body & b)
+            {
+                b.def = getIndex();
+                b.hash = get();
+            }
+
+            template<typename T>
+            void get(std::vector<T> & v)
+            {
+                const std::uint64_t n = get();
+                // each element takes at least one byte
+                if (!ok || n > std::uint64_t(end - data))
+                {
+                    ok = false;
+                    return;
+                }
+                v.resize(n);
+                for (auto && x : v)
+                {
+                    get(x);
+                }
+            }
+        };
+
+        RowId get(const std::vector<RowId> & ids, const std::uint32_t i)
+        {
+            return i < ids.size() ? ids[i] : 0;
+        }
+    }
+
+    void Records::write(DB & db) const
+    {
+        std::vector<RowId> defIds;
+        std::vector<RowId> declIds;
+        defIds.reserve(definitions.size());
+        declIds.reserve(declarations.size());
+
+        for (auto && i : definitions)
+        {
+            defIds.push_back(db.insertDefinition(i));
+        }
+
+        for (auto && i : declarations)
+        {
+            declIds.push_back(db.insertDeclaration(i.info, get(defIds, i.def)));
+        }
+
+        for (auto && i : callsResolved)
+        {
+            db.insertCallResolved(get(defIds, i.caller), get(defIds, i.callee), i.line, i.col, i.isvirtual);
+        }
+
+        for (auto && i : callsUnresolved)
+        {
+            db.insertCallUnresolved(get(defIds, i.caller), get(declIds, i.callee), i.line, i.col, i.isvirtual);
+        }
+
+        for (auto && i : overridesResolved)
+        {
+            db.insertVirtualResolved(get(defIds, i.def), get(defIds, i.vdef));
+        }
+
+        for (auto && i : overridesUnresolved)
+        {
+            db.insertVirtualUnresolved(get(defIds, i.def), get(declIds, i.vdef));
+        }
+
+        for (auto && i : templates)
+        {
+            db.insertTemplate(get(defIds, i.def), i.count, i.sample);
+        }
+
+        for (auto && i : bodies)
+        {
+            db.insertBody(get(defIds, i.def), i.hash);
+        }
+    }
+
+    void Records::serialize(std::string & out) const
+    {
+        Encoder enc(out);
+        enc.put(definitions);
+        enc.put(declarations);
+        enc.put(callsResolved);
+        enc.put(callsUnresolved);
+        enc.put(overridesResolved);
+        enc.put(overridesUnresolved);
+        enc.put(templates);
+        enc.put(bodies);
+    }
+
+    bool Records::deserialize(const char * data, const std::size_t size)
+    {
+        Decoder dec(data, size);
+        dec.get(definitions);
+        dec.get(declarations);
+        dec.get(callsResolved);
+        dec.get(callsUnresolved);
+        dec.get(overridesResolved);
+        dec.get(overridesUnresolved);
+        dec.get(templates);
+        dec.get(bodies);
+
+        return dec && dec.atEnd();
+    }
+
+    std::size_t Records::size() const
+    {
+        return definitions.size() + declarations.size()
+            + callsResolved.size() + callsUnresolved.size()
+            + overridesResolved.size() + overridesUnresolved.size()
+            + templates.size() + bodies.size();
+    }
+}
@@ -0,0 +1,76 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __RECORDS_HXX__
+#define __RECORDS_HXX__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "DB.hxx"
+#include "info.hxx"
+
+namespace mocoda
+{
+    // Everything collected in a TU: the edges refer to the definitions and
+    // declarations by their index in the corresponding vector.
+    struct Records
+    {
+        static const std::uint32_t NONE = std::uint32_t(-1);
+
+        struct Declaration
+        {
+            Info info;
+            std::uint32_t def;
+        };
+
+        struct Call
+        {
+            std::uint32_t caller;
+            std::uint32_t callee;
+            std::uint32_t line;
+            std::uint32_t col;
+            bool isvirtual;
+        };
+
+        struct Override
+        {
+            std::uint32_t def;
+            std::uint32_t vdef;
+        };
+
+        // the number of instantiations of a template collected in the TU
+        // and the name of one of them (see MOCODA_COLLAPSE)
+        struct Template
+        {
+            std::uint32_t def;
+            std::uint32_t count;
+            std::string sample;
+        };
+
+        // hash of the tokens of a definition (see MOCODA_HASH)
+        struct Body
+        {
+            std::uint32_t def;
+            std::uint64_t hash;
+        };
+
+        std::vector<Info> definitions;
+        std::vector<Declaration> declarations;
+        std::vector<Call> callsResolved;
+        std::vector<Call> callsUnresolved;
+        std::vector<Override> overridesResolved;
+        std::vector<Override> overridesUnresolved;
+        std::vector<Template> templates;
+        std::vector<Body> bodies;
+
+        void write(DB & db) const;
+        void serialize(std::string & out) const;
+        bool deserialize(const char * data, const std::size_t size);
+        std::size_t size() const;
+    };
+}
+
+#endif // __RECORDS_HXX__
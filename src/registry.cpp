@@ -0,0 +1,105 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "registry.hxx"
+#include "utils.hxx"
+
+namespace mocoda
+{
+    namespace
+    {
+        const std::size_t MAX_PROBES = 128;
+    }
+
+    Registry::Registry(const std::string & path, std::size_t __capacity) : slots(nullptr), capacity(0)
+    {
+        if (path.empty())
+        {
+            return;
+        }
+
+        const int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd == -1)
+        {
+            std::cerr << "Can't open registry: " << path << std::endl;
+            return;
+        }
+
+        // the first process sets the size and the others use it: ftruncate
+        // only adds zeros so it doesn't matter if several processes race
+        struct stat st;
+        if (fstat(fd, &st) == 0)
+        {
+            if (st.st_size == 0 && ftruncate(fd, __capacity * sizeof(std::uint64_t)) == 0)
+            {
+                st.st_size = __capacity * sizeof(std::uint64_t);
+            }
+
+            if (st.st_size > 0)
+            {
+                void * m = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (m != MAP_FAILED)
+                {
+                    slots = static_cast<std::uint64_t *>(m);
+                    capacity = st.st_size / sizeof(std::uint64_t);
+                }
+            }
+        }
+        close(fd);
+    }
+
+    Registry::~Registry()
+    {
+        if (slots)
+        {
+            munmap(slots, capacity * sizeof(std::uint64_t));
+        }
+    }
+
+    bool Registry::insert(std::uint64_t key)
+    {
+        if (!slots)
+        {
+            return true;
+        }
+
+        // 0 is an empty slot
+        if (key == 0)
+        {
+            key = 1;
+        }
+
+        std::size_t pos = key % capacity;
+        for (std::size_t i = 0; i < MAX_PROBES; ++i)
+        {
+            std::uint64_t expected = 0;
+            if (__atomic_compare_exchange_n(slots + pos, &expected, key, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                return true;
+            }
+            else if (expected == key)
+            {
+                return false;
+            }
+            pos = (pos + 1) % capacity;
+        }
+
+        return true;
+    }
+
+    std::uint64_t Registry::hash(const Info & i)
+    {
+        std::uint64_t h = utils::hash64(i.filename.c_str(), i.filename.size() + 1);
+        h = utils::hash64(i.funname.c_str(), i.funname.size() + 1, h);
+        h = utils::hash64(&i.begin, sizeof(i.begin), h);
+        return utils::hash64(&i.end, sizeof(i.end), h);
+    }
+}
@@ -0,0 +1,49 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __REGISTRY_HXX__
+#define __REGISTRY_HXX__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "info.hxx"
+
+namespace mocoda
+{
+    // Set of the functions already collected, shared by all the compiler
+    // processes through a mmap'ed file (MOCODA_REGISTRY): it's an open
+    // addressing hash table of 64-bit keys filled with atomic CAS, so no
+    // lock is needed.
+    // A function is registered before its body is traversed, so if the
+    // process which registered it doesn't push its data then the function
+    // is lost: the registry must be removed before each build.
+    class Registry
+    {
+        std::uint64_t * slots;
+        std::size_t capacity;
+
+    public:
+
+        Registry(const std::string & path, std::size_t __capacity = std::size_t(1) << 24);
+        ~Registry();
+
+        Registry(const Registry &) = delete;
+        Registry & operator=(const Registry &) = delete;
+
+        operator bool() const
+            {
+                return slots != nullptr;
+            }
+
+        // add the key and return true if it wasn't already there
+        // (or if the registry is full)
+        bool insert(std::uint64_t key);
+
+        static std::uint64_t hash(const Info & i);
+    };
+}
+
+#endif // __REGISTRY_HXX__
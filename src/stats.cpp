@@ -0,0 +1,144 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+// mocoda-stats: report where the plugin spends its time from the
+// counters written for each TU when MOCODA_STATS is set.
+//
+// Usage: mocoda-stats [-n COUNT] STATS_OR_DIRECTORY...
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "counters.hxx"
+#include "utils.hxx"
+
+namespace mocoda
+{
+    typedef std::function<double(const Counters &)> Key;
+
+    bool read(const std::string & path, std::vector<Counters> & all)
+    {
+        std::ifstream in(path);
+        if (!in)
+        {
+            std::cerr << "Can't open stats file: " << path << std::endl;
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(in, line))
+        {
+            Counters c;
+            if (c.parse(line))
+            {
+                all.push_back(c);
+            }
+        }
+
+        return true;
+    }
+
+    void top(std::vector<Counters> & all, const char * title, const Key & key, const int precision, const std::size_t count)
+    {
+        std::sort(all.begin(), all.end(), [&key](const Counters & a, const Counters & b)
+                  {
+                      return key(a) > key(b);
+                  });
+
+        std::cout << '\n' << title << ":\n";
+        for (std::size_t i = 0; i < std::min(count, all.size()); ++i)
+        {
+            std::cout << std::setw(14) << std::fixed << std::setprecision(precision) << key(all[i])
+                      << "  " << all[i].tu << '\n';
+        }
+    }
+
+    void report(std::vector<Counters> & all, const std::size_t count)
+    {
+        Counters total;
+        for (auto && c : all)
+        {
+            total.traverse += c.traverse;
+            total.collect += c.collect;
+            total.lock += c.lock;
+            total.write += c.write;
+            total.commit += c.commit;
+            total.definitions += c.definitions;
+            total.declarations += c.declarations;
+            total.calls += c.calls;
+            total.overrides += c.overrides;
+            total.maxrss = std::max(total.maxrss, c.maxrss);
+        }
+
+        std::cout << std::fixed << std::setprecision(3)
+                  << "TUs: " << all.size() << '\n'
+                  << "Time (s): traverse " << total.traverse
+                  << ", collect " << total.collect
+                  << ", lock wait " << total.lock
+                  << ", write " << total.write
+                  << ", commit " << total.commit << '\n'
+                  << "Emitted: " << total.definitions << " definitions, "
+                  << total.declarations << " declarations, "
+                  << total.calls << " calls, "
+                  << total.overrides << " overrides\n"
+                  << "Peak RSS (KB): " << total.maxrss << '\n';
+
+        top(all, "Slowest traversals (s)", [](const Counters & c) { return c.traverse; }, 3, count);
+        top(all, "Worst lock waits (s)", [](const Counters & c) { return c.lock; }, 3, count);
+        top(all, "Slowest writes and commits (s)", [](const Counters & c) { return c.write + c.commit; }, 3, count);
+        top(all, "Largest emitters (rows)", [](const Counters & c) { return double(c.emitted()); }, 0, count);
+        top(all, "Largest peak RSS (KB)", [](const Counters & c) { return double(c.maxrss); }, 0, count);
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    std::size_t count = 10;
+    int first = 1;
+    if (argc > 2 && std::strcmp(argv[1], "-n") == 0)
+    {
+        count = std::strtoul(argv[2], nullptr, 10);
+        first = 3;
+    }
+
+    if (first >= argc)
+    {
+        std::cerr << "Usage: " << argv[0] << " [-n COUNT] STATS_OR_DIRECTORY..." << std::endl;
+        return 1;
+    }
+
+    std::vector<mocoda::Counters> all;
+    int ret = 0;
+    for (int i = first; i < argc; ++i)
+    {
+        struct stat st;
+        if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            for (auto && path : utils::listFiles(argv[i], ".stats"))
+            {
+                if (!mocoda::read(path, all))
+                {
+                    ret = 1;
+                }
+            }
+        }
+        else if (!mocoda::read(argv[i], all))
+        {
+            ret = 1;
+        }
+    }
+
+    mocoda::report(all, count);
+
+    return ret;
+}
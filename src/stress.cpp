@@ -0,0 +1,326 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+// mocoda-stress: measure how the writes to the database scale with the
+// number of concurrent writers. Each writer is a process pushing the
+// records of synthetic TUs with the protocol of DataCollector::push
+// (MOCODA_LOCK and DB), and one JSON object is written for each number
+// of writers:
+//   wall: time to push all the TUs
+//   tus, rows: TUs and rows pushed per second
+//   lock: percentiles of the time spent waiting on the lock
+//   write: percentiles of the time spent writing and committing a TU
+//   size: size of the database
+//
+// Usage: mocoda-stress [-n WRITERS] [-t TUS] [-f FUNCTIONS] [-d DECLARATIONS]
+//                      [-c CALLS] [-o OVERLAP] [-h HEADERS] [-i] [-s SEED] DIRECTORY
+//
+//   -n: comma-separated numbers of writers (default 1,2,4,8,16,32,64)
+//   -t: number of TUs pushed by each writer
+//   -f: number of definitions in each TU
+//   -d: number of declarations in each TU
+//   -c: number of calls in each definition
+//   -o: percentage of the functions coming from the headers shared by all the TUs
+//   -h: number of functions in the headers
+//   -i: the functions have an id (as with MOCODA_ID)
+//
+// DIRECTORY contains the database, the lock and the stats of the TUs
+// (see mocoda-stats). MOCODA_BULK is used as in the plugin.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "counters.hxx"
+#include "records.hxx"
+#include "utils.hxx"
+
+namespace mocoda
+{
+    struct Load
+    {
+        std::vector<unsigned> writers;
+        unsigned tus;
+        unsigned functions;
+        unsigned declarations;
+        unsigned calls;
+        unsigned overlap;
+        unsigned headers;
+        bool useId;
+        std::uint32_t seed;
+
+        Load() : writers({ 1, 2, 4, 8, 16, 32, 64 }), tus(8), functions(200), declarations(100), calls(4),
+                 overlap(50), headers(2000), useId(false), seed(1) { }
+    };
+
+    class Writer
+    {
+        const Load & load;
+        const std::string dir;
+        std::uint32_t state;
+
+    public:
+
+        Writer(const Load & __load, const std::string & __dir, const unsigned w) : load(__load), dir(__dir), state(__load.seed + w * 7919u) { }
+
+        bool run(const unsigned w);
+
+    private:
+
+        // a LCG is enough and makes the TUs the same everywhere
+        unsigned random(const unsigned n)
+            {
+                state = state * 1103515245u + 12345u;
+                return (state >> 16) % n;
+            }
+
+        Info function(const unsigned tu, const unsigned i, const bool definition);
+        Records generate(const unsigned tu);
+        bool push(const Records & records, const unsigned tu);
+    };
+
+    // the functions of the headers are the same in all the TUs so a TU
+    // mostly finds the rows of its shared functions in the database
+    Info Writer::function(const unsigned tu, const unsigned i, const bool definition)
+    {
+        std::string filename, funname;
+        unsigned n;
+        if (random(100) < load.overlap)
+        {
+            n = random(load.headers);
+            filename = "include/h" + std::to_string(n % 64) + ".h";
+            funname = std::string(definition ? "h::f" : "h::g") + std::to_string(n) + "(int)";
+            n /= 64;
+        }
+        else
+        {
+            n = i;
+            filename = "src/tu" + std::to_string(tu) + ".cpp";
+            funname = std::string(definition ? "tu" : "decl") + std::to_string(tu) + "::f" + std::to_string(i) + "(int)";
+        }
+
+        const std::uint64_t id = load.useId ? utils::hash64(funname.data(), funname.size()) : 0;
+        return Info(filename, funname, 10 * n + 1, 10 * n + (definition ? 8 : 1), id);
+    }
+
+    Records Writer::generate(const unsigned tu)
+    {
+        Records records;
+        for (unsigned i = 0; i < load.functions; ++i)
+        {
+            records.definitions.push_back(function(tu, i, true));
+        }
+        for (unsigned i = 0; i < load.declarations; ++i)
+        {
+            records.declarations.push_back({ function(tu, i, false), Records::NONE });
+        }
+
+        for (std::uint32_t i = 0; i < records.definitions.size(); ++i)
+        {
+            for (unsigned j = 0; j < load.calls; ++j)
+            {
+                const std::uint32_t line = records.definitions[i].begin + 1 + j;
+                if (!records.declarations.empty() && random(2))
+                {
+                    records.callsUnresolved.push_back({ i, random(records.declarations.size()), line, 5, false });
+                }
+                else
+                {
+                    records.callsResolved.push_back({ i, random(records.definitions.size()), line, 5, false });
+                }
+            }
+        }
+
+        return records;
+    }
+
+    bool Writer::push(const Records & records, const unsigned tu)
+    {
+        Counters counters;
+        counters.tu = "src/tu" + std::to_string(tu) + ".cpp";
+
+        Stopwatch watch;
+        const std::string lock = dir + "/lock";
+        const int fd = open(lock.c_str(), O_RDONLY);
+        const int s = flock(fd, LOCK_EX);
+        counters.lock = watch.lap();
+        if (s != 0)
+        {
+            std::cerr << "Can't lock: " << lock << std::endl;
+            close(fd);
+            return false;
+        }
+
+        {
+            DB db(dir + "/db.sqlite");
+            records.write(db);
+            counters.write = watch.lap();
+            db.commit();
+            counters.commit = watch.lap();
+        }
+        flock(fd, LOCK_UN);
+        close(fd);
+
+        counters.definitions = records.definitions.size();
+        counters.declarations = records.declarations.size();
+        counters.calls = records.callsResolved.size() + records.callsUnresolved.size();
+        counters.setMaxRSS();
+
+        return counters.append(dir);
+    }
+
+    bool Writer::run(const unsigned w)
+    {
+        for (unsigned t = 0; t < load.tus; ++t)
+        {
+            const unsigned tu = w * load.tus + t;
+            if (!push(generate(tu), tu))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    double percentile(std::vector<double> & values, const double p)
+    {
+        if (values.empty())
+        {
+            return 0;
+        }
+        std::sort(values.begin(), values.end());
+        return values[std::min(values.size() - 1, std::size_t(p * values.size()))];
+    }
+
+    bool stress(const Load & load, const std::string & dir, const unsigned writers)
+    {
+        for (auto && f : { "/db.sqlite", "/db.sqlite-journal", "/db.sqlite-wal", "/mocoda.stats" })
+        {
+            std::remove((dir + f).c_str());
+        }
+        std::ofstream(dir + "/lock");
+
+        Stopwatch watch;
+        std::vector<pid_t> pids;
+        for (unsigned w = 0; w < writers; ++w)
+        {
+            const pid_t pid = fork();
+            if (pid == 0)
+            {
+                _exit(Writer(load, dir, w).run(w) ? 0 : 1);
+            }
+            else if (pid == -1)
+            {
+                std::cerr << "Can't fork a writer" << std::endl;
+                break;
+            }
+            pids.push_back(pid);
+        }
+
+        bool ok = pids.size() == writers;
+        for (auto && pid : pids)
+        {
+            int status;
+            ok = waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0 && ok;
+        }
+        const double wall = watch.lap();
+
+        std::vector<double> locks, writes;
+        std::uint64_t rows = 0;
+        std::ifstream in(dir + "/mocoda.stats");
+        std::string line;
+        while (std::getline(in, line))
+        {
+            Counters c;
+            if (c.parse(line))
+            {
+                locks.push_back(c.lock);
+                writes.push_back(c.write + c.commit);
+                rows += c.emitted();
+            }
+        }
+
+        struct stat st;
+        const std::uint64_t size = stat((dir + "/db.sqlite").c_str(), &st) == 0 ? st.st_size : 0;
+
+        std::cout << "{\"writers\": " << writers
+                  << ", \"wall\": " << wall
+                  << ", \"tus\": " << locks.size() / wall
+                  << ", \"rows\": " << rows / wall
+                  << ", \"lock\": {\"p50\": " << percentile(locks, 0.5)
+                  << ", \"p90\": " << percentile(locks, 0.9)
+                  << ", \"p99\": " << percentile(locks, 0.99)
+                  << ", \"max\": " << percentile(locks, 1)
+                  << "}, \"write\": {\"p50\": " << percentile(writes, 0.5)
+                  << ", \"p90\": " << percentile(writes, 0.9)
+                  << ", \"p99\": " << percentile(writes, 0.99)
+                  << ", \"max\": " << percentile(writes, 1)
+                  << "}, \"size\": " << size << "}" << std::endl;
+
+        return ok;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    mocoda::Load load;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:f:d:c:o:h:is:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            load.writers.clear();
+            for (auto && n : utils::split(optarg, ','))
+            {
+                load.writers.push_back(std::strtoul(n.c_str(), nullptr, 10));
+            }
+            break;
+        case 't': load.tus = std::strtoul(optarg, nullptr, 10); break;
+        case 'f': load.functions = std::strtoul(optarg, nullptr, 10); break;
+        case 'd': load.declarations = std::strtoul(optarg, nullptr, 10); break;
+        case 'c': load.calls = std::strtoul(optarg, nullptr, 10); break;
+        case 'o': load.overlap = std::strtoul(optarg, nullptr, 10); break;
+        case 'h': load.headers = std::max(1ul, std::strtoul(optarg, nullptr, 10)); break;
+        case 'i': load.useId = true; break;
+        case 's': load.seed = std::strtoul(optarg, nullptr, 10); break;
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-n WRITERS] [-t TUS] [-f FUNCTIONS] [-d DECLARATIONS]"
+                      << " [-c CALLS] [-o OVERLAP] [-h HEADERS] [-i] [-s SEED] DIRECTORY" << std::endl;
+            return 1;
+        }
+    }
+
+    if (optind + 1 != argc)
+    {
+        std::cerr << "Usage: " << argv[0] << " [-n WRITERS] [-t TUS] [-f FUNCTIONS] [-d DECLARATIONS]"
+                  << " [-c CALLS] [-o OVERLAP] [-h HEADERS] [-i] [-s SEED] DIRECTORY" << std::endl;
+        return 1;
+    }
+
+    const std::string dir = argv[optind];
+    mkdir(dir.c_str(), 0755);
+
+    int ret = 0;
+    for (auto && writers : load.writers)
+    {
+        if (writers && !mocoda::stress(load, dir, writers))
+        {
+            ret = 1;
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,63 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <cstring>
+
+#include "strpool.hxx"
+#include "utils.hxx"
+
+namespace mocoda
+{
+    StringPool::StringPool() : table(1024, 0)
+    {
+        intern("", 0);
+    }
+
+    bool StringPool::equals(const std::uint32_t id, const char * s, const std::size_t size) const
+    {
+        return strings[id].second == size && std::memcmp(arena.data() + strings[id].first, s, size) == 0;
+    }
+
+    std::uint32_t StringPool::intern(const char * s, const std::size_t size)
+    {
+        const std::size_t mask = table.size() - 1;
+        std::size_t pos = utils::hash64(s, size) & mask;
+        while (const std::uint32_t slot = table[pos])
+        {
+            if (equals(slot - 1, s, size))
+            {
+                return slot - 1;
+            }
+            pos = (pos + 1) & mask;
+        }
+
+        const std::uint32_t id = strings.size();
+        strings.emplace_back(arena.size(), size);
+        arena.insert(arena.end(), s, s + size);
+        table[pos] = id + 1;
+
+        if (strings.size() * 4 > table.size() * 3)
+        {
+            grow();
+        }
+
+        return id;
+    }
+
+    void StringPool::grow()
+    {
+        std::vector<std::uint32_t> t(table.size() * 2, 0);
+        const std::size_t mask = t.size() - 1;
+        for (std::uint32_t id = 0; id < strings.size(); ++id)
+        {
+            std::size_t pos = utils::hash64(arena.data() + strings[id].first, strings[id].second) & mask;
+            while (t[pos])
+            {
+                pos = (pos + 1) & mask;
+            }
+            t[pos] = id + 1;
+        }
+        table.swap(t);
+    }
+}
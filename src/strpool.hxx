@@ -0,0 +1,52 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __STRPOOL_HXX__
+#define __STRPOOL_HXX__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mocoda
+{
+    // Interned strings stored one after the other in a single arena:
+    // a string is identified by a 32-bit id and the empty string is 0.
+    class StringPool
+    {
+        std::vector<char> arena;
+        // offset in the arena and size of each string
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> strings;
+        // open addressing table of ids + 1 (0 is an empty slot)
+        std::vector<std::uint32_t> table;
+
+    public:
+
+        StringPool();
+
+        std::uint32_t intern(const char * s, const std::size_t size);
+        std::uint32_t intern(const std::string & s)
+            {
+                return intern(s.data(), s.size());
+            }
+
+        std::string str(const std::uint32_t id) const
+            {
+                return std::string(arena.data() + strings[id].first, strings[id].second);
+            }
+
+        std::size_t size() const
+            {
+                return strings.size();
+            }
+
+    private:
+
+        bool equals(const std::uint32_t id, const char * s, const std::size_t size) const;
+        void grow();
+    };
+}
+
+#endif // __STRPOOL_HXX__
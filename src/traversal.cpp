@@ -0,0 +1,166 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+
+#include <fnmatch.h>
+
+#include "traversal.hxx"
+
+namespace mocoda
+{
+    const std::uint32_t Traversal::NONE;
+
+    Traversal::Traversal(const CallGraph & __graph) : graph(__graph),
+                                                      depths(__graph.defCount(), NONE),
+                                                      parents(__graph.defCount(), NONE) { }
+
+    void Traversal::reset()
+    {
+        for (auto && i : visited)
+        {
+            depths[i] = NONE;
+            parents[i] = NONE;
+        }
+        visited.clear();
+    }
+
+    std::vector<std::uint32_t> Traversal::match(const std::string & pattern) const
+    {
+        if (pattern.find_first_of("*?[") == std::string::npos)
+        {
+            const Range<std::uint32_t> r = graph.find(pattern);
+            return std::vector<std::uint32_t>(r.begin(), r.end());
+        }
+
+        std::vector<std::uint32_t> defs;
+        for (std::uint32_t i = 0; i < graph.defCount(); ++i)
+        {
+            if (fnmatch(pattern.c_str(), graph.name(i), 0) == 0)
+            {
+                defs.push_back(i);
+            }
+        }
+        return defs;
+    }
+
+    template<typename F>
+    void Traversal::neighbours(const std::uint32_t i, const Direction direction, const bool virtuals, F && fun)
+    {
+        if (direction == CALLEES)
+        {
+            for (auto && e : graph.callees(i))
+            {
+                fun(e.target);
+                if (virtuals && (e.flags & format::VIRTUAL))
+                {
+                    for (auto && o : graph.overriders(e.target))
+                    {
+                        fun(o);
+                    }
+                }
+            }
+        }
+        else
+        {
+            for (auto && e : graph.callers(i))
+            {
+                fun(e.target);
+            }
+            if (virtuals)
+            {
+                // a virtual call to a method overridden by i can be dispatched to i
+                for (auto && o : graph.overridden(i))
+                {
+                    for (auto && e : graph.callers(o))
+                    {
+                        if (e.flags & format::VIRTUAL)
+                        {
+                            fun(e.target);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    template<typename F>
+    std::uint32_t Traversal::bfs(const std::vector<std::uint32_t> & sources, const Direction direction,
+                                 const std::uint32_t maxDepth, const bool virtuals, F && stop)
+    {
+        reset();
+        for (auto && s : sources)
+        {
+            if (depths[s] == NONE)
+            {
+                depths[s] = 0;
+                visited.push_back(s);
+                if (stop(s))
+                {
+                    return s;
+                }
+            }
+        }
+
+        std::uint32_t found = NONE;
+        for (std::size_t k = 0; k < visited.size() && found == NONE; ++k)
+        {
+            const std::uint32_t i = visited[k];
+            const std::uint32_t depth = depths[i];
+            if (maxDepth && depth >= maxDepth)
+            {
+                continue;
+            }
+
+            neighbours(i, direction, virtuals, [&](const std::uint32_t j)
+                       {
+                           if (depths[j] == NONE)
+                           {
+                               depths[j] = depth + 1;
+                               parents[j] = i;
+                               visited.push_back(j);
+                               if (found == NONE && stop(j))
+                               {
+                                   found = j;
+                               }
+                           }
+                       });
+        }
+
+        return found;
+    }
+
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> Traversal::reach(const std::vector<std::uint32_t> & sources, const Direction direction,
+                                                                          const std::uint32_t maxDepth, const bool virtuals)
+    {
+        bfs(sources, direction, maxDepth, virtuals, [](const std::uint32_t) { return false; });
+
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> defs;
+        defs.reserve(visited.size());
+        for (auto && i : visited)
+        {
+            defs.emplace_back(i, depths[i]);
+        }
+        return defs;
+    }
+
+    std::vector<std::uint32_t> Traversal::path(const std::vector<std::uint32_t> & sources, const std::vector<std::uint32_t> & targets,
+                                               const std::uint32_t maxDepth, const bool virtuals)
+    {
+        std::vector<std::uint32_t> sorted(targets);
+        std::sort(sorted.begin(), sorted.end());
+        std::uint32_t i = bfs(sources, CALLEES, maxDepth, virtuals, [&sorted](const std::uint32_t j)
+                              {
+                                  return std::binary_search(sorted.begin(), sorted.end(), j);
+                              });
+
+        std::vector<std::uint32_t> chain;
+        for (; i != NONE; i = parents[i])
+        {
+            chain.push_back(i);
+        }
+        std::reverse(chain.begin(), chain.end());
+        return chain;
+    }
+}
@@ -0,0 +1,61 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __TRAVERSAL_HXX__
+#define __TRAVERSAL_HXX__
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "callgraph.hxx"
+
+namespace mocoda
+{
+    // Breadth-first traversals of a CallGraph. The state is kept between
+    // the queries so a query only costs what it visits.
+    class Traversal
+    {
+        const CallGraph & graph;
+        std::vector<std::uint32_t> depths;
+        std::vector<std::uint32_t> parents;
+        // the visited definitions in the order of the traversal
+        std::vector<std::uint32_t> visited;
+
+    public:
+
+        static const std::uint32_t NONE = std::uint32_t(-1);
+
+        enum Direction
+        {
+            CALLEES,
+            CALLERS,
+        };
+
+        Traversal(const CallGraph & __graph);
+
+        // the definitions with this name or matching this shell wildcard pattern
+        std::vector<std::uint32_t> match(const std::string & pattern) const;
+        // the definitions reachable from the sources with their depth (0 for the sources)
+        // when maxDepth is 0 the depth isn't limited. When virtuals is true a virtual call
+        // can reach all the methods overriding the callee.
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> reach(const std::vector<std::uint32_t> & sources, const Direction direction,
+                                                                   const std::uint32_t maxDepth, const bool virtuals);
+        // a shortest chain of calls from one of the sources to one of the targets (empty if none)
+        std::vector<std::uint32_t> path(const std::vector<std::uint32_t> & sources, const std::vector<std::uint32_t> & targets,
+                                        const std::uint32_t maxDepth, const bool virtuals);
+
+    private:
+
+        void reset();
+        template<typename F>
+        void neighbours(const std::uint32_t i, const Direction direction, const bool virtuals, F && fun);
+        template<typename F>
+        std::uint32_t bfs(const std::vector<std::uint32_t> & sources, const Direction direction,
+                          const std::uint32_t maxDepth, const bool virtuals, F && stop);
+    };
+}
+
+#endif // __TRAVERSAL_HXX__
@@ -1,5 +1,10 @@
+#include <algorithm>
 #include <fstream>
 
+#include <dirent.h>
+#include <fnmatch.h>
+#include <unistd.h>
+
 #include "utils.hxx"
 
 namespace utils
@@ -18,9 +23,12 @@ namespace utils
 
     std::string getRealPath(const std::string & path)
     {
-        static char real_path[PATH_MAX];
-        realpath(path.c_str(), real_path);
-        return std::string(real_path);
+        char real_path[PATH_MAX];
+        if (realpath(path.c_str(), real_path))
+        {
+            return std::string(real_path);
+        }
+        return path;
     }
     
     std::string getEnv(const char * name)
@@ -32,5 +40,79 @@ namespace utils
         }
         return std::string();
     }
-    
+
+    std::vector<std::string> split(const std::string & s, const char sep)
+    {
+        std::vector<std::string> parts;
+        std::size_t start = 0;
+        while (start <= s.length())
+        {
+            std::size_t pos = s.find(sep, start);
+            if (pos == std::string::npos)
+            {
+                pos = s.length();
+            }
+            if (pos > start)
+            {
+                parts.push_back(s.substr(start, pos - start));
+            }
+            start = pos + 1;
+        }
+        return parts;
+    }
+
+    bool match(const std::string & path, const std::vector<std::string> & patterns)
+    {
+        for (auto && pattern : patterns)
+        {
+            if (fnmatch(pattern.c_str(), path.c_str(), 0) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::uint64_t hash64(const void * data, const std::size_t size, std::uint64_t seed)
+    {
+        const unsigned char * p = static_cast<const unsigned char *>(data);
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            seed ^= p[i];
+            seed *= 0x100000001b3ULL;
+        }
+        return seed;
+    }
+
+    std::string getUniqueFile(const std::string & dir, const std::string & prefix, const std::string & suffix)
+    {
+        std::string path = dir + '/' + prefix + "XXXXXX" + suffix;
+        const int fd = mkstemps(&path[0], suffix.length());
+        if (fd == -1)
+        {
+            return std::string();
+        }
+        close(fd);
+        return path;
+    }
+
+    std::vector<std::string> listFiles(const std::string & dir, const std::string & suffix)
+    {
+        std::vector<std::string> files;
+        if (DIR * d = opendir(dir.c_str()))
+        {
+            while (struct dirent * e = readdir(d))
+            {
+                const std::string name(e->d_name);
+                if (name.length() > suffix.length() && name.compare(name.length() - suffix.length(), suffix.length(), suffix) == 0)
+                {
+                    files.push_back(dir + '/' + name);
+                }
+            }
+            closedir(d);
+        }
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
 }
@@ -1,8 +1,10 @@
 #ifndef __UTILS_HXX__
 #define __UTILS_HXX__
 
+#include <cstdint>
 #include <cstdlib>
 #include <string>
+#include <vector>
 #include <limits.h>
 
 namespace utils
@@ -12,6 +14,13 @@ namespace utils
     bool startswith(const std::string & a, const std::string & b);
     std::string getRealPath(const std::string & path);
     std::string getEnv(const char * name);
+    std::vector<std::string> split(const std::string & s, const char sep);
+    // true if the path matches one of the shell wildcard patterns
+    bool match(const std::string & path, const std::vector<std::string> & patterns);
+    // FNV-1a: stable across processes and builds
+    std::uint64_t hash64(const void * data, const std::size_t size, std::uint64_t seed = 0xcbf29ce484222325ULL);
+    std::string getUniqueFile(const std::string & dir, const std::string & prefix, const std::string & suffix);
+    std::vector<std::string> listFiles(const std::string & dir, const std::string & suffix);
 
 }
 
@@ -0,0 +1,138 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+// test-callgraph: check that CallGraph::load rejects the truncated images
+// and the images whose sections point out of the file or out of the graph,
+// and that it accepts the image built by GraphBuilder.
+//
+// Usage: test-callgraph DIR
+//
+// The database of the graph is written in DIR.
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "DB.hxx"
+#include "graphbuilder.hxx"
+#include "records.hxx"
+
+namespace mocoda
+{
+    std::vector<char> makeImage(const std::string & path)
+    {
+        std::remove(path.c_str());
+        {
+            Records records;
+            for (std::uint32_t i = 0; i < 100; ++i)
+            {
+                records.definitions.emplace_back("file" + std::to_string(i % 5) + ".cpp", "f" + std::to_string(i) + "()", i + 1, i + 2);
+                records.callsResolved.push_back({ i, (i * 7 + 3) % 100, i + 1, 1, false });
+                records.callsResolved.push_back({ i, (i * 13 + 1) % 100, i + 2, 1, true });
+            }
+            for (std::uint32_t i = 1; i < 10; ++i)
+            {
+                records.overridesResolved.push_back({ i, i - 1 });
+            }
+            DB db(path);
+            records.write(db);
+            db.commit();
+        }
+
+        GraphBuilder builder;
+        return builder.load(path) ? builder.build() : std::vector<char>();
+    }
+
+    bool accepts(const std::vector<char> & image)
+    {
+        CallGraph graph;
+        return graph.load(image.data(), image.size());
+    }
+
+    // the image with a change in its header
+    std::vector<char> corrupt(const std::vector<char> & image, const std::function<void(format::Header &)> & change)
+    {
+        std::vector<char> copy(image);
+        format::Header header;
+        std::memcpy(&header, copy.data(), sizeof(header));
+        change(header);
+        std::memcpy(copy.data(), &header, sizeof(header));
+        return copy;
+    }
+
+    // the image with a change in a section
+    template<typename T>
+    std::vector<char> corrupt(const std::vector<char> & image, const std::uint64_t format::Header::*section, const std::size_t i, const T & value)
+    {
+        std::vector<char> copy(image);
+        format::Header header;
+        std::memcpy(&header, copy.data(), sizeof(header));
+        std::memcpy(copy.data() + header.*section + i * sizeof(T), &value, sizeof(T));
+        return copy;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc != 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " DIR" << std::endl;
+        return 1;
+    }
+
+    using namespace mocoda;
+    const std::vector<char> image = makeImage(std::string(argv[1]) + "/callgraph.sqlite");
+    if (image.empty() || !accepts(image))
+    {
+        std::cerr << "The image built by GraphBuilder is rejected" << std::endl;
+        return 1;
+    }
+
+    std::uint32_t errors = 0;
+    auto expect = [&errors](const bool ok, const char * what)
+        {
+            if (!ok)
+            {
+                std::cerr << "Accepted: " << what << std::endl;
+                ++errors;
+            }
+        };
+
+    for (std::size_t size = 0; size < image.size(); ++size)
+    {
+        if (accepts(std::vector<char>(image.begin(), image.begin() + size)))
+        {
+            std::cerr << "Accepted: image truncated at " << size << std::endl;
+            ++errors;
+        }
+    }
+
+    format::Header header;
+    std::memcpy(&header, image.data(), sizeof(header));
+    const std::uint32_t n = header.defCount;
+
+    expect(!accepts(corrupt(image, [](format::Header & h) { h.version += 1; })), "wrong version");
+    expect(!accepts(corrupt(image, [](format::Header & h) { h.size += 8; })), "size beyond the file");
+    expect(!accepts(corrupt(image, [](format::Header & h) { h.defCount += 1000; })), "too many definitions");
+    expect(!accepts(corrupt(image, [](format::Header & h) { h.edgeCount += 1000; })), "too many edges");
+    expect(!accepts(corrupt(image, [](format::Header & h) { h.callees = h.size; })), "callees at the end of the file");
+    expect(!accepts(corrupt(image, [](format::Header & h) { h.callers += 1; })), "misaligned callers");
+    expect(!accepts(corrupt(image, [](format::Header & h) { h.overriders = std::uint64_t(-8); })), "overriders out of the file");
+    expect(!accepts(corrupt(image, [](format::Header & h) { h.files = h.strings - 8; })), "files before the strings");
+    expect(!accepts(corrupt(image, &format::Header::callees, 0, format::Edge({ n, 0, 0, 0 }))), "callee out of the graph");
+    expect(!accepts(corrupt(image, &format::Header::callers, 0, format::Edge({ n, 0, 0, 0 }))), "caller out of the graph");
+    expect(!accepts(corrupt(image, &format::Header::calleesIndex, 1, std::uint32_t(header.edgeCount + 1))), "callees index beyond the edges");
+    expect(!accepts(corrupt(image, &format::Header::calleesIndex, 0, std::uint32_t(1))), "callees index not starting at 0");
+    expect(!accepts(corrupt(image, &format::Header::callersIndex, 2, std::uint32_t(0))), "callers index decreasing");
+    expect(!accepts(corrupt(image, &format::Header::overridden, 0, n)), "overridden method out of the graph");
+    expect(!accepts(corrupt(image, &format::Header::byName, 0, n)), "name index out of the graph");
+    expect(!accepts(corrupt(image, &format::Header::files, 0, std::uint32_t(header.files - header.strings))), "file name out of the strings");
+    expect(!accepts(corrupt(image, &format::Header::defs, 0, format::Definition({ header.fileCount, 0, 1, 1 }))), "file out of the graph");
+
+    std::cout << "errors: " << errors << std::endl;
+    return errors == 0 ? 0 : 1;
+}
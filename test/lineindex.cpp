@@ -0,0 +1,162 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+// test-lineindex: compare the answers of LineIndex (see lineindex.hxx) with
+// a scan of all the definitions on random files of nested definitions.
+//
+// Usage: test-lineindex
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "lineindex.hxx"
+
+namespace mocoda
+{
+    // definitions in [lo, hi] one after the other, each with its own nested
+    // definitions, none having the same lines as its parent
+    void generate(std::mt19937 & rng, std::vector<Info> & defs, const std::string & file,
+                  const std::uint32_t lo, const std::uint32_t hi, const std::uint32_t depth)
+    {
+        std::uint32_t line = lo;
+        while (line <= hi)
+        {
+            const std::uint32_t begin = line + rng() % 3;
+            if (begin > hi)
+            {
+                break;
+            }
+            std::uint32_t end = begin + rng() % std::min<std::uint32_t>(30, hi - begin + 1);
+            if (depth && begin == lo && end == hi)
+            {
+                if (end == begin)
+                {
+                    break;
+                }
+                --end;
+            }
+
+            defs.emplace_back(file, "f" + std::to_string(defs.size()) + "()", begin, end);
+            if (depth < 3 && end > begin)
+            {
+                generate(rng, defs, file, begin, end, depth + 1);
+            }
+            line = end + 1;
+        }
+    }
+
+    bool covers(const Info & def, const std::string & file, const std::uint32_t line)
+    {
+        return def.filename == file && def.begin <= line && line <= def.end;
+    }
+
+    // the definitions covering a line from the innermost to the outermost
+    std::vector<std::uint32_t> scanEnclosing(const std::vector<Info> & defs, const std::string & file, const std::uint32_t line)
+    {
+        std::vector<std::uint32_t> result;
+        for (std::uint32_t i = 0; i < defs.size(); ++i)
+        {
+            if (covers(defs[i], file, line))
+            {
+                result.push_back(i);
+            }
+        }
+        std::sort(result.begin(), result.end(), [&defs](const std::uint32_t a, const std::uint32_t b)
+                  {
+                      return defs[a].begin != defs[b].begin ? defs[a].begin > defs[b].begin : defs[a].end < defs[b].end;
+                  });
+        return result;
+    }
+
+    std::vector<std::uint32_t> scanTouched(const std::vector<Info> & defs, const std::string & file,
+                                           const std::vector<std::pair<std::uint32_t, std::uint32_t>> & ranges)
+    {
+        std::vector<std::uint32_t> result;
+        for (std::uint32_t i = 0; i < defs.size(); ++i)
+        {
+            for (auto && r : ranges)
+            {
+                if (defs[i] && defs[i].filename == file && defs[i].begin <= r.second && r.first <= defs[i].end)
+                {
+                    result.push_back(i);
+                    break;
+                }
+            }
+        }
+        return result;
+    }
+}
+
+int main()
+{
+    using namespace mocoda;
+    std::mt19937 rng(42);
+    std::uint32_t errors = 0;
+    auto expect = [&errors](const bool ok, const std::string & what)
+        {
+            if (!ok)
+            {
+                std::cerr << "Wrong answer: " << what << std::endl;
+                ++errors;
+            }
+        };
+
+    for (std::uint32_t round = 0; round < 50; ++round)
+    {
+        const std::uint32_t lines = 50 + rng() % 500;
+        std::vector<Info> defs;
+        for (std::uint32_t f = 0; f < 3; ++f)
+        {
+            generate(rng, defs, "file" + std::to_string(f) + ".cpp", 1, lines, 0);
+        }
+        // an invalid definition is ignored
+        defs.emplace_back("file0.cpp", "invalid()", 10, 5);
+        std::shuffle(defs.begin(), defs.end(), rng);
+
+        LineIndex index;
+        for (auto && d : defs)
+        {
+            index.add(d);
+        }
+        index.build();
+
+        for (std::uint32_t f = 0; f < 4; ++f)
+        {
+            const std::string file = "file" + std::to_string(f) + ".cpp";
+            for (std::uint32_t line = 0; line <= lines + 2; ++line)
+            {
+                const std::vector<std::uint32_t> expected = scanEnclosing(defs, file, line);
+                const std::string where = file + ":" + std::to_string(line);
+                expect(index.enclosing(file, line) == expected, "enclosing " + where);
+                expect(index.innermost(file, line) == (expected.empty() ? LineIndex::NONE : expected[0]), "innermost " + where);
+            }
+
+            for (std::uint32_t k = 0; k < 20; ++k)
+            {
+                std::vector<std::pair<std::uint32_t, std::uint32_t>> ranges;
+                for (std::uint32_t r = rng() % 4; r > 0; --r)
+                {
+                    const std::uint32_t first = rng() % (lines + 2);
+                    ranges.emplace_back(first, first + rng() % 20);
+                }
+                expect(index.touched(file, ranges) == scanTouched(defs, file, ranges), "touched " + file);
+            }
+        }
+    }
+
+    // when two definitions overlap, the one beginning last is the innermost
+    LineIndex overlap;
+    overlap.add(Info("a.cpp", "a()", 10, 20));
+    overlap.add(Info("a.cpp", "b()", 15, 30));
+    overlap.build();
+    expect(overlap.innermost("a.cpp", 12) == 0 && overlap.innermost("a.cpp", 17) == 1
+           && overlap.innermost("a.cpp", 25) == 1 && overlap.innermost("a.cpp", 31) == LineIndex::NONE, "overlap");
+
+    std::cout << "errors: " << errors << std::endl;
+    return errors == 0 ? 0 : 1;
+}
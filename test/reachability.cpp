@@ -0,0 +1,234 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this file,
+// You can obtain one at http://mozilla.org/MPL/2.0/.
+
+// test-reachability: compare the answers of the reachability index (see
+// reachability.hxx) with a plain BFS on random call graphs, once the index
+// has been built and once it has been updated after random changes, and
+// check that the truncated indices are rejected.
+//
+// Usage: test-reachability DIR
+//
+// The databases of the graphs are written in DIR.
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "DB.hxx"
+#include "graphbuilder.hxx"
+#include "reachability.hxx"
+#include "records.hxx"
+
+namespace mocoda
+{
+    // the callees of each definition
+    typedef std::vector<std::vector<std::uint32_t>> Calls;
+
+    // mostly calls to the previous definitions with a few calls back to
+    // make some cycles, as in a real code base
+    Calls generate(std::mt19937 & rng, const std::uint32_t n)
+    {
+        Calls calls(n);
+        for (std::uint32_t i = 1; i < n; ++i)
+        {
+            const std::uint32_t count = rng() % 4;
+            for (std::uint32_t k = 0; k < count; ++k)
+            {
+                calls[i].push_back(rng() % i);
+            }
+            if (rng() % 8 == 0)
+            {
+                calls[rng() % i].push_back(i);
+            }
+        }
+        return calls;
+    }
+
+    // change the calls of a few definitions, and add some new definitions
+    void mutate(std::mt19937 & rng, Calls & calls, const std::uint32_t changes)
+    {
+        for (std::uint32_t k = 0; k < changes; ++k)
+        {
+            const std::uint32_t n = calls.size();
+            switch (rng() % 3)
+            {
+            case 0:
+                calls[rng() % n].push_back(rng() % n);
+                break;
+            case 1:
+            {
+                std::vector<std::uint32_t> & callees = calls[rng() % n];
+                if (!callees.empty())
+                {
+                    callees.erase(callees.begin() + rng() % callees.size());
+                }
+                break;
+            }
+            default:
+                calls.emplace_back(1, rng() % n);
+                break;
+            }
+        }
+    }
+
+    bool load(const std::string & path, const Calls & calls, CallGraph & graph, std::vector<char> & image)
+    {
+        std::remove(path.c_str());
+        {
+            Records records;
+            for (std::uint32_t i = 0; i < calls.size(); ++i)
+            {
+                records.definitions.emplace_back("file" + std::to_string(i % 7) + ".cpp", "f" + std::to_string(i) + "()", i + 1, i + 1);
+                for (auto && j : calls[i])
+                {
+                    records.callsResolved.push_back({ i, j, i + 1, 1, false });
+                }
+            }
+            DB db(path);
+            records.write(db);
+            db.commit();
+        }
+        return GraphBuilder::open(path, graph, image);
+    }
+
+    std::uint32_t check(const CallGraph & graph, const std::vector<char> & image)
+    {
+        ReachabilityIndex index;
+        if (!index.load(image.data(), image.size()))
+        {
+            std::cerr << "The index can't be loaded" << std::endl;
+            return 1;
+        }
+
+        std::uint32_t errors = 0;
+        const std::uint32_t n = graph.defCount();
+        std::vector<std::uint32_t> seen(n, n), todo;
+        for (std::uint32_t from = 0; from < n; ++from)
+        {
+            // a definition reaches itself
+            seen[from] = from;
+            todo.assign(1, from);
+            while (!todo.empty())
+            {
+                const std::uint32_t v = todo.back();
+                todo.pop_back();
+                for (auto && e : graph.callees(v))
+                {
+                    if (seen[e.target] != from)
+                    {
+                        seen[e.target] = from;
+                        todo.push_back(e.target);
+                    }
+                }
+            }
+
+            for (std::uint32_t to = 0; to < n; ++to)
+            {
+                if (index.reaches(from, to) != (seen[to] == from))
+                {
+                    ++errors;
+                }
+            }
+        }
+
+        return errors;
+    }
+
+    std::vector<format::Signature> getSignatures(const CallGraph & graph)
+    {
+        // the names are unique so the indices are enough as keys
+        std::vector<format::Signature> signatures(graph.defCount());
+        std::vector<std::uint64_t> keys;
+        for (std::uint32_t i = 0; i < graph.defCount(); ++i)
+        {
+            signatures[i].key = std::hash<std::string>()(graph.name(i));
+        }
+        for (std::uint32_t i = 0; i < graph.defCount(); ++i)
+        {
+            keys.clear();
+            for (auto && e : graph.callees(i))
+            {
+                keys.push_back(signatures[e.target].key);
+            }
+            std::sort(keys.begin(), keys.end());
+            keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+            signatures[i].calls = keys.size();
+            for (auto && k : keys)
+            {
+                signatures[i].calls = signatures[i].calls * 1000003 ^ k;
+            }
+        }
+        return signatures;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc != 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " DIR" << std::endl;
+        return 1;
+    }
+
+    using namespace mocoda;
+    const std::string dir = argv[1];
+    std::mt19937 rng(42);
+    std::uint32_t errors = 0;
+    std::uint32_t updates = 0;
+    for (std::uint32_t round = 0; round < 20; ++round)
+    {
+        Calls calls = generate(rng, 50 + rng() % 200);
+        CallGraph graph;
+        std::vector<char> graphImage;
+        if (!load(dir + "/reachability-old.sqlite", calls, graph, graphImage))
+        {
+            return 1;
+        }
+        std::vector<char> image = ReachabilityIndex::build(graph, getSignatures(graph), 0);
+        errors += check(graph, image);
+        for (std::size_t size = 0; size < image.size(); ++size)
+        {
+            ReachabilityIndex index;
+            if (index.load(image.data(), size))
+            {
+                std::cerr << "Accepted: index truncated at " << size << std::endl;
+                ++errors;
+            }
+        }
+
+        // each index is updated from the previous one
+        for (std::uint32_t step = 0; step < 5; ++step)
+        {
+            ReachabilityIndex old;
+            old.load(image.data(), image.size());
+            mutate(rng, calls, 1 + rng() % 3);
+            CallGraph next;
+            std::vector<char> nextImage;
+            if (!load(dir + "/reachability-new.sqlite", calls, next, nextImage))
+            {
+                return 1;
+            }
+
+            std::vector<char> updated = ReachabilityIndex::update(old, next, getSignatures(next), 0);
+            if (updated.empty())
+            {
+                updated = ReachabilityIndex::build(next, getSignatures(next), 0);
+            }
+            else
+            {
+                ++updates;
+            }
+            errors += check(next, updated);
+            image = std::move(updated);
+        }
+    }
+
+    std::cout << "updates: " << updates << ", errors: " << errors << std::endl;
+    return errors == 0 && updates != 0 ? 0 : 1;
+}